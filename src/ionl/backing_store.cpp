@@ -2,6 +2,7 @@
 
 #include <ionl/document.hpp>
 #include <ionl/macros.hpp>
+#include <ionl/markdown.hpp>
 #include <ionl/sqlite_helper.hpp>
 #include <ionl/utils.hpp>
 
@@ -15,6 +16,25 @@
 using namespace std::literals;
 using namespace Ionl;
 
+static uint64_t HashUtf8(std::string_view utf8) {
+    // FNV-1a: the hash gets persisted, so it must not depend on the standard library or the platform
+    uint64_t hash = 0xcbf29ce484222325;
+    for (char c : utf8) {
+        hash ^= (uint8_t)c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+uint64_t Ionl::HashBulletText(const GapBuffer& text, std::string& scratch) {
+    if (text.IsPacked()) {
+        return HashUtf8(text.packed->utf8);
+    } else {
+        text.ExtractContent(scratch);
+        return HashUtf8(scratch);
+    }
+}
+
 class SQLiteBackingStore::Private {
 public:
     SQLiteDatabase database;
@@ -31,6 +51,15 @@ public:
     SQLiteStatement setBulletContent;
     SQLiteStatement setBulletPositionAtBeginning;
     SQLiteStatement setBulletPositionAfter;
+    SQLiteStatement getCachedTextRuns;
+    SQLiteStatement storeCachedTextRuns;
+    SQLiteStatement invalidateCachedTextRuns;
+
+    // Reused across SetBulletContent() calls to hold the serialized text, so that flushing many bullets doesn't
+    // allocate a new string for each one
+    std::string contentScratch;
+    // Same as above, for StoreCachedTextRuns()
+    std::vector<uint8_t> textRunsScratch;
 
 public:
     void SetDatabaseUserVersion() {
@@ -96,6 +125,28 @@ ON Bullets(ModifyTime);
         // clang-format on
         assert(result == SQLITE_OK);
     }
+
+    // Tables of data derived from the bullets, which can be thrown away at any time. They are created on every open
+    // if missing, so adding one doesn't need CURRENT_DATABASE_VERSION to change.
+    void InitializeCacheTables() {
+        // clang-format off
+        int result = sqlite3_exec(database, R"""(
+CREATE TABLE IF NOT EXISTS TextRunCache(
+    Pbid INTEGER PRIMARY KEY REFERENCES Bullets(Pbid) ON DELETE CASCADE,
+    -- HashBulletText() of the text the TextRun's were parsed from
+    ContentHash INTEGER,
+    -- kMarkdownParserVersion
+    ParserVersion INTEGER,
+    -- SerializeTextRuns()
+    TextRuns BLOB
+);
+)""",
+            nullptr,
+            nullptr,
+            nullptr);
+        // clang-format on
+        assert(result == SQLITE_OK);
+    }
 };
 
 SQLiteBackingStore::SQLiteBackingStore(const char* dbPath)
@@ -142,6 +193,7 @@ SQLiteBackingStore::SQLiteBackingStore(const char* dbPath)
             throw std::runtime_error(msg);
         }
     }
+    m->InitializeCacheTables();
 
     m->beginTransaction.Initialize(m->database, "BEGIN TRANSACTION");
     m->commitTransaction.Initialize(m->database, "COMMIT TRANSACTION");
@@ -226,6 +278,28 @@ FROM (
     WHERE Pbid = ?3
 ) AS _Anchor
 WHERE Pbid = ?1
+)"""sv);
+
+    m->getCachedTextRuns.Initialize(m->database, R"""(
+SELECT TextRuns
+FROM TextRunCache
+WHERE Pbid = ?1
+  AND ContentHash = ?2
+  AND ParserVersion = ?3
+)"""sv);
+
+    // NOTE: the bullet may have been deleted since the TextRun's were computed, skip instead of violating the foreign key
+    m->storeCachedTextRuns.Initialize(m->database, R"""(
+INSERT OR REPLACE INTO TextRunCache(Pbid, ContentHash, ParserVersion, TextRuns)
+SELECT ?1, ?2, ?3, ?4
+WHERE EXISTS (SELECT 1 FROM Bullets WHERE Pbid = ?1)
+)"""sv);
+
+    // NOTE: `IS NOT` so that leaving ?2 as NULL drops the entry no matter what
+    m->invalidateCachedTextRuns.Initialize(m->database, R"""(
+DELETE FROM TextRunCache
+WHERE Pbid = ?1
+  AND ContentHash IS NOT ?2
 )"""sv);
 }
 
@@ -267,7 +341,9 @@ Bullet SQLiteBackingStore::FetchBullet(Pbid pbid) {
                 auto cstr = rt.ResultColumn<const char*>(/*2nd*/ 1);
                 std::string_view content(cstr ? cstr : "");
                 result.content.v = BulletContentTextual{
-                    .text = GapBuffer(content),
+                    // Keep the content as UTF-8 until the bullet is actually displayed or edited
+                    .text = GapBuffer(content, /*packed*/ true),
+                    .textBuffer = nullptr,
                 };
             } break;
 
@@ -328,18 +404,33 @@ void SQLiteBackingStore::DeleteBullet(Pbid bullet) {
 
 void SQLiteBackingStore::SetBulletContent(Pbid bullet, const BulletContent& bulletContent) {
     SQLiteRunningStatement rt(m->setBulletContent);
+    SQLiteRunningStatement rtInvalidate(m->invalidateCachedTextRuns);
     rt.BindArgument(1, bullet);
+    rtInvalidate.BindArgument(1, bullet);
     ::VisitVariantOverloaded(
         bulletContent.v,
         [&](const BulletContentTextual& bc) {
             rt.BindArgument(2, (int)BulletType::Textual);
-            rt.BindArgument(3, bc.text.ExtractContent());
+            // NOTE: arguments are bound without copying (SQLITE_STATIC), so the text must stay alive until the statement is done
+            std::string_view text;
+            auto& gapBuffer = bc.GetText();
+            if (gapBuffer.IsPacked()) {
+                text = gapBuffer.packed->utf8;
+            } else {
+                gapBuffer.ExtractContent(m->contentScratch);
+                text = m->contentScratch;
+            }
+            rt.BindArgument(3, text);
+            // Cached data derived from the same text stays valid, e.g. when the content is set without having changed
+            rtInvalidate.BindArgument(2, HashUtf8(text));
         },
         [&](const BulletContentMirror& bc) {
             rt.BindArgument(2, (int)BulletType::Mirror);
             rt.BindArgument(3, (int64_t)bc.referee);
+            // ?2 left as NULL: drop everything
         });
     rt.StepUntilDone();
+    rtInvalidate.StepUntilDone();
 }
 
 void SQLiteBackingStore::SetBulletPositionAfter(Pbid bullet, Pbid newParent, Pbid relativeTo) {
@@ -367,6 +458,32 @@ void SQLiteBackingStore::SetBulletPositionAtBeginning(Pbid bullet, Pbid newParen
     rt.StepUntilDone();
 }
 
+bool SQLiteBackingStore::FetchCachedTextRuns(Pbid bullet, const GapBuffer& text, std::vector<TextRun>& out) {
+    uint64_t textHash = HashBulletText(text, m->contentScratch);
+
+    SQLiteRunningStatement rt(m->getCachedTextRuns);
+    rt.BindArguments(bullet, textHash, kMarkdownParserVersion);
+    if (rt.Step() != SQLITE_ROW) {
+        return false;
+    }
+
+    // A corrupted entry is treated as if there were none, it gets overwritten by the next StoreCachedTextRuns()
+    auto data = rt.ResultColumn<std::span<const uint8_t>>(0);
+    return DeserializeTextRuns(data, text.GetContentSize(), out);
+}
+
+void SQLiteBackingStore::StoreCachedTextRuns(Pbid bullet, const GapBuffer& text, const std::vector<TextRun>& logicalRuns) {
+    uint64_t textHash = HashBulletText(text, m->contentScratch);
+    SerializeTextRuns(logicalRuns, m->textRunsScratch);
+    StoreCachedTextRuns(bullet, textHash, m->textRunsScratch);
+}
+
+void SQLiteBackingStore::StoreCachedTextRuns(Pbid bullet, uint64_t textHash, std::span<const uint8_t> serializedRuns) {
+    SQLiteRunningStatement rt(m->storeCachedTextRuns);
+    rt.BindArguments(bullet, textHash, kMarkdownParserVersion, serializedRuns);
+    rt.StepUntilDone();
+}
+
 struct DbopDeleteBullet {
     Pbid bullet;
 };
@@ -374,6 +491,11 @@ struct DbopSetBulletContent {
     Pbid bullet;
     const BulletContent* bulletContent;
 };
+struct DbopStoreCachedTextRuns {
+    Pbid bullet;
+    uint64_t textHash;
+    std::vector<uint8_t> serializedRuns;
+};
 struct DbopSetBulletPosition {
     Pbid bullet;
     Pbid newParent;
@@ -392,7 +514,8 @@ struct WriteDelayedBackingStore::QueuedOperation {
         std::monostate,
         DbopDeleteBullet,
         DbopSetBulletContent,
-        DbopSetBulletPosition>
+        DbopSetBulletPosition,
+        DbopStoreCachedTextRuns>
         v;
 };
 
@@ -448,6 +571,24 @@ void WriteDelayedBackingStore::SetBulletPositionAtBeginning(Pbid bullet, Pbid ne
     });
 }
 
+bool WriteDelayedBackingStore::FetchCachedTextRuns(Pbid bullet, const GapBuffer& text, std::vector<TextRun>& out) {
+    // NOTE: no need to flush, the entry is checked against `text`; the queued ops can only make this miss
+    return mReceiver->FetchCachedTextRuns(bullet, text, out);
+}
+
+void WriteDelayedBackingStore::StoreCachedTextRuns(Pbid bullet, const GapBuffer& text, const std::vector<TextRun>& logicalRuns) {
+    // Both may change before the ops get flushed, capture them now
+    DbopStoreCachedTextRuns dbop{
+        .bullet = bullet,
+        .textHash = HashBulletText(text, mContentScratch),
+        .serializedRuns = {},
+    };
+    SerializeTextRuns(logicalRuns, dbop.serializedRuns);
+    mQueuedOps.push_back(QueuedOperation{
+        .v = std::move(dbop),
+    });
+}
+
 size_t WriteDelayedBackingStore::GetUnflushedOpsCount() const {
     return mQueuedOps.size();
 }
@@ -463,8 +604,12 @@ void WriteDelayedBackingStore::FlushOps() {
 
     mReceiver->BeginTransaction();
 
-    robin_hood::unordered_set<Pbid> lastSeenSetBulletContent;
-    robin_hood::unordered_set<Pbid> lastSeenSetBulletPosition;
+    auto& lastSeenSetBulletContent = mLastSeenSetBulletContent;
+    auto& lastSeenSetBulletPosition = mLastSeenSetBulletPosition;
+    auto& lastSeenStoreCachedTextRuns = mLastSeenStoreCachedTextRuns;
+    lastSeenSetBulletContent.clear();
+    lastSeenSetBulletPosition.clear();
+    lastSeenStoreCachedTextRuns.clear();
 
     // Collapse duplicate events
     for (size_t i = mQueuedOps.size(); i >= 1;) {
@@ -484,6 +629,10 @@ void WriteDelayedBackingStore::FlushOps() {
             [&](const DbopSetBulletPosition& dbop) {
                 auto [_, inserted] = lastSeenSetBulletPosition.insert(dbop.bullet);
                 if (!inserted) op.v = {};
+            },
+            [&](const DbopStoreCachedTextRuns& dbop) {
+                auto [_, inserted] = lastSeenStoreCachedTextRuns.insert(dbop.bullet);
+                if (!inserted) op.v = {};
             });
     }
 
@@ -503,6 +652,9 @@ void WriteDelayedBackingStore::FlushOps() {
                 } else {
                     mReceiver->SetBulletPositionAtBeginning(op.bullet, op.newParent);
                 }
+            },
+            [&](const DbopStoreCachedTextRuns& op) {
+                mReceiver->StoreCachedTextRuns(op.bullet, op.textHash, op.serializedRuns);
             });
     }
 
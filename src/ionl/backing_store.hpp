@@ -1,12 +1,22 @@
 #pragma once
 
 #include <ionl/document.hpp>
+#include <ionl/markdown.hpp>
 
+#include <robin_hood.h>
+#include <cstdint>
 #include <memory>
+#include <span>
+#include <string>
 #include <vector>
 
 namespace Ionl {
 
+/// Hash of a bullet's text in the form it is persisted (UTF-8), for telling whether data cached alongside the bullet
+/// was derived from its current text. Stable across runs and platforms.
+/// \param scratch Holds the UTF-8 text if `text` is not packed, passed in to reuse its capacity.
+uint64_t HashBulletText(const GapBuffer& text, std::string& scratch);
+
 class IBackingStore {
 public:
     virtual ~IBackingStore() = default;
@@ -19,6 +29,15 @@ public:
     // TODO merge these two ops into one?
     virtual void SetBulletPositionAfter(Pbid bullet, Pbid newParent, Pbid relativeTo) = 0;
     virtual void SetBulletPositionAtBeginning(Pbid bullet, Pbid newParent) = 0;
+
+    // TextRun's persisted across sessions, so that bullets whose text hasn't changed don't need to be parsed again.
+    // They are tied to the text they were parsed from (by HashBulletText()) and kMarkdownParserVersion, and get
+    // dropped when the bullet's content is set to something else.
+    /// \param text The bullet's current text.
+    /// \return Whether there are TextRun's for `text`, in which case they are written to `out` in logical indices.
+    virtual bool FetchCachedTextRuns(Pbid bullet, const GapBuffer& text, std::vector<TextRun>& out) = 0;
+    /// \param logicalRuns TextRun's parsed from `text`, in logical indices (see TextBuffer::logicalTextRuns).
+    virtual void StoreCachedTextRuns(Pbid bullet, const GapBuffer& text, const std::vector<TextRun>& logicalRuns) = 0;
 };
 
 class SQLiteBackingStore : public IBackingStore {
@@ -42,6 +61,10 @@ public:
     void SetBulletContent(Pbid bullet, const BulletContent& bulletContent) override;
     void SetBulletPositionAfter(Pbid bullet, Pbid newParent, Pbid relativeTo) override;
     void SetBulletPositionAtBeginning(Pbid bullet, Pbid newParent) override;
+    bool FetchCachedTextRuns(Pbid bullet, const GapBuffer& text, std::vector<TextRun>& out) override;
+    void StoreCachedTextRuns(Pbid bullet, const GapBuffer& text, const std::vector<TextRun>& logicalRuns) override;
+    /// Same as above, with the text hashed and the TextRun's serialized already.
+    void StoreCachedTextRuns(Pbid bullet, uint64_t textHash, std::span<const uint8_t> serializedRuns);
 };
 
 class WriteDelayedBackingStore : public IBackingStore {
@@ -50,6 +73,11 @@ private:
 
     SQLiteBackingStore* mReceiver;
     std::vector<QueuedOperation> mQueuedOps;
+    // Scratch space for FlushOps(), kept around to reuse their storage
+    robin_hood::unordered_set<Pbid> mLastSeenSetBulletContent;
+    robin_hood::unordered_set<Pbid> mLastSeenSetBulletPosition;
+    robin_hood::unordered_set<Pbid> mLastSeenStoreCachedTextRuns;
+    std::string mContentScratch;
 
 public:
     WriteDelayedBackingStore(SQLiteBackingStore& receiver);
@@ -63,6 +91,8 @@ public:
     void SetBulletContent(Pbid bullet, const BulletContent& bulletContent) override;
     void SetBulletPositionAfter(Pbid bullet, Pbid newParent, Pbid relativeTo) override;
     void SetBulletPositionAtBeginning(Pbid bullet, Pbid newParent) override;
+    bool FetchCachedTextRuns(Pbid bullet, const GapBuffer& text, std::vector<TextRun>& out) override;
+    void StoreCachedTextRuns(Pbid bullet, const GapBuffer& text, const std::vector<TextRun>& logicalRuns) override;
 
     size_t GetUnflushedOpsCount() const;
     void ClearOps();
@@ -0,0 +1,113 @@
+#include "bulk_parse.hpp"
+
+#include <memory>
+
+Ionl::BulkMarkdownParser::BulkMarkdownParser(WorkerPool& pool)
+    : mPool{ &pool } //
+{
+}
+
+Ionl::BulkMarkdownParser::~BulkMarkdownParser() {
+    // Jobs refer to `this`, they must be gone before we are
+    std::unique_lock lock(mMutex);
+    mJobsDone.wait(lock, [&]() { return mRunningJobs == 0; });
+}
+
+void Ionl::BulkMarkdownParser::Submit(std::span<TextBuffer* const> buffers) {
+    struct JobItem {
+        TextBuffer* textBuffer;
+        uint64_t submission;
+        TextBufferSnapshot snapshot;
+    };
+    using Job = std::vector<JobItem>;
+
+    auto submitJob = [&](Job job) {
+        {
+            std::lock_guard lock(mMutex);
+            mRunningJobs += 1;
+        }
+        mPool->Submit([this, job = std::move(job)]() {
+            thread_local MarkdownParser parser;
+
+            std::vector<Completed> results;
+            results.reserve(job.size());
+            for (auto& item : job) {
+                results.push_back(Completed{
+                    .textBuffer = item.textBuffer,
+                    .submission = item.submission,
+                    .result = ParseSnapshot(item.snapshot, parser),
+                });
+            }
+
+            std::lock_guard lock(mMutex);
+            for (auto& result : results) {
+                mCompleted.push_back(std::move(result));
+            }
+            mRunningJobs -= 1;
+            // NOTE: notify while holding the lock, otherwise the destructor may wake up and destroy `this` before this
+            // gets to run
+            mJobsDone.notify_all();
+        });
+    };
+
+    Job job;
+    int64_t jobContentSize = 0;
+    for (TextBuffer* tb : buffers) {
+        if (tb->parsedContentSize != -1 || mPending.contains(tb)) {
+            continue;
+        }
+
+        uint64_t submission = mNextSubmission++;
+        mPending.emplace(tb, submission);
+        job.push_back(JobItem{
+            .textBuffer = tb,
+            .submission = submission,
+            .snapshot = tb->TakeSnapshotForParsing(),
+        });
+        jobContentSize += tb->gapBuffer.GetContentSize();
+        if (jobContentSize >= kBulkParseJobContentSize) {
+            submitJob(std::move(job));
+            job = {};
+            jobContentSize = 0;
+        }
+    }
+    if (!job.empty()) {
+        submitJob(std::move(job));
+    }
+}
+
+void Ionl::BulkMarkdownParser::Cancel(TextBuffer& tb) {
+    // The job may still be running, its result is dropped when it gets published
+    mPending.erase(&tb);
+}
+
+int Ionl::BulkMarkdownParser::PublishResults() {
+    std::vector<Completed> completed;
+    {
+        std::lock_guard lock(mMutex);
+        completed.swap(mCompleted);
+    }
+
+    int count = 0;
+    for (auto& c : completed) {
+        // NOTE: check before touching the TextBuffer at all, it may have been cancelled and destroyed already
+        auto iter = mPending.find(c.textBuffer);
+        if (iter == mPending.end() || iter->second != c.submission) {
+            continue;
+        }
+        mPending.erase(iter);
+
+        if (c.textBuffer->ApplyParseResult(std::move(c.result))) {
+            count += 1;
+        }
+    }
+    return count;
+}
+
+void Ionl::BulkMarkdownParser::WaitAndPublishResults() {
+    {
+        std::unique_lock lock(mMutex);
+        mJobsDone.wait(lock, [&]() { return mRunningJobs == 0; });
+    }
+    PublishResults();
+}
@@ -0,0 +1,70 @@
+// Parsing many TextBuffer's at once on a WorkerPool, e.g. when expanding a large subtree or opening a notebook, where
+// parsing each bullet one by one on the UI thread would stall it.
+//
+// Usage: construct the TextBuffer's with `deferParse`, Submit() them, and call PublishResults() on the UI thread (e.g.
+// once per frame) until GetPendingCount() reaches 0. A TextBuffer that is edited in the meantime stays usable: its
+// result gets the edited paragraphs reparsed on top when published, or is discarded if RefreshCaches() got to it first.
+#pragma once
+
+#include <ionl/text_buffer.hpp>
+#include <ionl/worker_pool.hpp>
+
+#include <robin_hood.h>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace Ionl {
+
+// Submitted TextBuffer's are grouped into jobs of about this much content (in characters), so that scheduling overhead
+// doesn't dominate for the typical bullet, which is tiny
+constexpr int64_t kBulkParseJobContentSize = 64 * 1024;
+
+class BulkMarkdownParser {
+private:
+    WorkerPool* mPool;
+
+    struct Completed {
+        TextBuffer* textBuffer;
+        uint64_t submission;
+        TextBufferParseResult result;
+    };
+
+    std::mutex mMutex;
+    std::condition_variable mJobsDone;
+    // Guarded by `mMutex`
+    std::vector<Completed> mCompleted;
+    int mRunningJobs = 0;
+
+    // UI thread only: TextBuffer's submitted and not yet published or cancelled, mapped to their submission number. A
+    // TextBuffer that got cancelled and destroyed may have its address reused by a new submission, this tells them apart.
+    robin_hood::unordered_flat_map<TextBuffer*, uint64_t> mPending;
+    uint64_t mNextSubmission = 0;
+
+public:
+    /// \param pool Must outlive this object.
+    explicit BulkMarkdownParser(WorkerPool& pool);
+    /// Waits for submitted jobs to finish, their results are discarded.
+    ~BulkMarkdownParser();
+
+    BulkMarkdownParser(const BulkMarkdownParser&) = delete;
+    BulkMarkdownParser& operator=(const BulkMarkdownParser&) = delete;
+
+    /// TextBuffer's that already have their cached data computed are skipped.
+    /// Each TextBuffer must stay alive until its result is published, or Cancel() is called on it.
+    void Submit(std::span<TextBuffer* const> buffers);
+    void Cancel(TextBuffer& tb);
+
+    /// Hand finished results to their TextBuffer's, see TextBuffer::ApplyParseResult().
+    /// \return Number of TextBuffer's that got updated.
+    int PublishResults();
+    /// Block until all submitted TextBuffer's have been parsed, and then publish them.
+    void WaitAndPublishResults();
+
+    size_t GetPendingCount() const { return mPending.size(); }
+};
+
+} // namespace Ionl
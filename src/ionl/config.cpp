@@ -32,6 +32,7 @@ void Ionl::LoadConfigFromFile(Config& cfg, const fs::path& file) {
     cfg.monospaceBoldFont = o["Style"]["MonospaceBoldFont"].value_or(""sv);
     cfg.monospaceBoldItalicFont = o["Style"]["MonospaceBoldItalicFont"].value_or(""sv);
     cfg.headingFont = o["Style"]["HeadingFont"].value_or(""sv);
+    cfg.undoJournalByteLimit = o["Editor"]["UndoJournalByteLimit"].value_or(kDefaultUndoJournalByteLimit);
 }
 
 Ionl::Config Ionl::gConfig{};
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <ionl/markdown.hpp>
+#include <ionl/undo_journal.hpp>
 
+#include <cstdint>
 #include <filesystem>
 #include <string>
 
@@ -19,6 +21,9 @@ struct Config {
     std::string monospaceBoldFont;
     std::string monospaceBoldItalicFont;
     std::string headingFont;
+
+    // Memory limit of the undo history of each TextEdit, in bytes
+    int64_t undoJournalByteLimit;
 };
 
 void LoadConfigFromFile(Config& cfg, const std::filesystem::path& file);
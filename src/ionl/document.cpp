@@ -1,9 +1,12 @@
 #include "document.hpp"
 
 #include <ionl/backing_store.hpp>
+#include <ionl/bulk_parse.hpp>
 #include <ionl/macros.hpp>
+#include <ionl/text_search.hpp>
 #include <ionl/utils.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <string_view>
 
@@ -128,6 +131,94 @@ void Ionl::Document::ReparentBullet(Bullet& bullet, Bullet& newParent, size_t in
     }
 }
 
+void Ionl::Document::LoadBulletTexts(std::span<Bullet* const> bullets, BulkMarkdownParser& parser, int64_t undoByteLimit) {
+    std::vector<Bullet*> parsedBullets;
+    std::vector<TextBuffer*> parsedBuffers;
+    std::vector<TextRun> cachedRuns;
+    for (Bullet* bullet : bullets) {
+        auto bc = std::get_if<BulletContentTextual>(&bullet->content.v);
+        if (!bc || bc->textBuffer || !bc->text.CanUnpack()) {
+            continue;
+        }
+
+        // Both leave `bc->text` empty
+        cachedRuns.clear();
+        if (mStore->FetchCachedTextRuns(bullet->pbid, bc->text, cachedRuns)) {
+            bc->textBuffer = std::make_unique<TextBuffer>(std::move(bc->text), std::move(cachedRuns), undoByteLimit);
+        } else {
+            bc->textBuffer = std::make_unique<TextBuffer>(std::move(bc->text), undoByteLimit, /*deferParse*/ true);
+            parsedBullets.push_back(bullet);
+            parsedBuffers.push_back(bc->textBuffer.get());
+        }
+    }
+
+    if (parsedBuffers.empty()) {
+        return;
+    }
+    parser.Submit(parsedBuffers);
+    parser.WaitAndPublishResults();
+    for (size_t i = 0; i < parsedBullets.size(); ++i) {
+        mStore->StoreCachedTextRuns(parsedBullets[i]->pbid, parsedBuffers[i]->gapBuffer, parsedBuffers[i]->logicalTextRuns);
+    }
+}
+
+void Ionl::Document::UnloadBulletText(Bullet& bullet) {
+    auto bc = std::get_if<BulletContentTextual>(&bullet.content.v);
+    if (!bc || !bc->textBuffer) {
+        return;
+    }
+
+    bc->text = std::move(bc->textBuffer->gapBuffer);
+    bc->textBuffer = nullptr;
+    bc->text.undoJournal = nullptr;
+    bc->text.Pack();
+}
+
+Ionl::GapCompactionStats Ionl::Document::CompactBulletGaps(const Bullet* editingBullet) {
+    GapCompactionStats stats;
+    for (auto& ob : mBullets) {
+        if (!ob.has_value() || &ob.value() == editingBullet) {
+            continue;
+        }
+
+        auto bc = std::get_if<BulletContentTextual>(&ob->content.v);
+        if (!bc) {
+            continue;
+        }
+
+        stats.buffersVisited += 1;
+        if (int64_t trimmed = ShrinkGapToFit(bc->GetText()); trimmed > 0) {
+            stats.buffersShrunk += 1;
+            stats.bytesTrimmed += trimmed;
+            // The TextRun's are mapped to buffer indices, which moved for everything after the gap
+            if (bc->textBuffer) {
+                bc->textBuffer->RefreshCaches();
+            }
+        }
+    }
+    return stats;
+}
+
+void Ionl::Document::SearchLoadedBullets(const SearchPattern& pattern, std::vector<BulletSearchMatch>& out) const {
+    std::vector<int64_t> matches;
+    for (auto& ob : mBullets) {
+        if (!ob.has_value()) {
+            continue;
+        }
+
+        auto bc = std::get_if<BulletContentTextual>(&ob->content.v);
+        if (!bc) {
+            continue;
+        }
+
+        matches.clear();
+        FindAllMatches(bc->GetText(), pattern, matches);
+        for (int64_t idx : matches) {
+            out.push_back({ .bullet = ob->pbid, .index = idx });
+        }
+    }
+}
+
 Ionl::Bullet* Ionl::Document::Store(Bullet bullet) {
     Bullet* result;
 
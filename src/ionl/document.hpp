@@ -1,12 +1,16 @@
 #pragma once
 
 #include <ionl/gap_buffer.hpp>
+#include <ionl/text_buffer.hpp>
 
 #include <robin_hood.h>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <variant>
 #include <vector>
@@ -34,7 +38,12 @@ enum class BulletType {
 };
 
 struct BulletContentTextual {
+    // Packed as fetched from the backing store. Moved into `textBuffer` once the bullet is shown, see Document::LoadBulletTexts().
     GapBuffer text;
+    std::unique_ptr<TextBuffer> textBuffer;
+
+    GapBuffer& GetText() { return textBuffer ? textBuffer->gapBuffer : text; }
+    const GapBuffer& GetText() const { return textBuffer ? textBuffer->gapBuffer : text; }
 };
 
 struct BulletContentMirror {
@@ -64,6 +73,21 @@ struct Bullet {
     bool IsRootBullet() const;
 };
 
+struct BulletSearchMatch {
+    Pbid bullet;
+    // Logical index into the bullet's text
+    int64_t index;
+};
+
+struct GapCompactionStats {
+    int64_t buffersVisited = 0;
+    int64_t buffersShrunk = 0;
+    // Handed back to the allocator with realloc(), which doesn't necessarily return them to the OS
+    int64_t bytesTrimmed = 0;
+};
+
+struct SearchPattern;
+class BulkMarkdownParser;
 class IBackingStore;
 class Document {
 private:
@@ -89,6 +113,24 @@ public:
     /// from the parent, and then added at the given index.
     void ReparentBullet(Bullet& bullet, Bullet& newParent, size_t index);
 
+    /// Give every textual bullet in `bullets` a TextBuffer (if it doesn't have one already), so that it can be shown and
+    /// edited with a TextEdit. TextRun's cached in the backing store are used when still valid, the rest are parsed
+    /// together on `parser`'s WorkerPool (blocking until done) and then cached.
+    /// Bullets whose text can't be unpacked (see GapBuffer::CanUnpack()) are skipped, and stay packed and read-only.
+    void LoadBulletTexts(std::span<Bullet* const> bullets, BulkMarkdownParser& parser, int64_t undoByteLimit);
+    /// Undo LoadBulletTexts() for `bullet` once it is no longer shown: the TextBuffer (and its undo history) is dropped,
+    /// and the text goes back to being packed. No TextEdit may be using the TextBuffer anymore.
+    void UnloadBulletText(Bullet& bullet);
+
+    /// Trim the gap of every loaded bullet's text, except `editingBullet`. Meant to be called when the app is idle, to
+    /// give back the memory left over from past edits (e.g. after pasting a lot of text into a bullet). Bullets with a
+    /// TextBuffer get its caches refreshed, since the text after the gap moves.
+    GapCompactionStats CompactBulletGaps(const Bullet* editingBullet = nullptr);
+
+    /// Search the text of every loaded bullet (packed or not), appending all matches to `out`.
+    /// NOTE: bullets that haven't been fetched from the backing store yet are not searched.
+    void SearchLoadedBullets(const SearchPattern& pattern, std::vector<BulletSearchMatch>& out) const;
+
 private:
     Bullet* Store(Bullet bullet);
 };
@@ -1,8 +1,13 @@
 #include "gap_buffer.hpp"
 
 #include <imgui/imgui_internal.h>
+#include <ionl/undo_journal.hpp>
+#include <ionl/utf8.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <cstring>
 #include <utility>
 
 static ImWchar* AllocateBuffer(size_t size) {
@@ -17,6 +22,112 @@ static void DeallocateBuffer(ImWchar* buffer) {
     free(buffer);
 }
 
+static std::unique_ptr<Ionl::PackedUtf8Content> MakePackedContent(std::string utf8) {
+    auto result = std::make_unique<Ionl::PackedUtf8Content>();
+
+    auto strBegin = utf8.data();
+    auto strEnd = utf8.data() + utf8.size();
+
+    // If every codepoint takes exactly 1 byte (i.e. ASCII), logical index == byte offset and we don't need an index
+    int64_t numCodepoints = Ionl::Utf8CountCodepoints(strBegin, strEnd);
+    if (numCodepoints == (int64_t)utf8.size()) {
+        result->codepointCount = numCodepoints;
+    } else {
+        // Same decoding rules as ImTextStrFromUtf8NoNullTerminate(), so that logical indices agree with the unpacked buffer
+        int64_t count = 0;
+        for (auto p = strBegin; p < strEnd;) {
+            if (count % Ionl::kPackedIndexStride == 0) {
+                result->codepointOffsets.push_back((uint32_t)(p - strBegin));
+            }
+            unsigned int c;
+            int n = ImTextCharFromUtf8(&c, p, strEnd);
+            // A U+FFFD that wasn't in the text to begin with, i.e. a character outside the BMP or invalid UTF-8
+            if (c == IM_UNICODE_CODEPOINT_INVALID && !(n == 3 && memcmp(p, "\xEF\xBF\xBD", 3) == 0)) {
+                result->fitsImWchar = false;
+            }
+            p += n;
+            count += 1;
+        }
+        result->codepointCount = count;
+    }
+
+    result->utf8 = std::move(utf8);
+    return result;
+}
+
+static void AppendNewlines(std::vector<int64_t>& out, const ImWchar* begin, const ImWchar* end, int64_t logicalOffset) {
+    for (auto p = begin; p != end; ++p) {
+        if (*p == '\n') {
+            out.push_back(logicalOffset + (p - begin));
+        }
+    }
+}
+
+struct Ionl::GapBufferShare {
+    // Number of GapBuffer's (the live one and all of its snapshots) using the storage
+    std::atomic<int32_t> refCount;
+    // Buffer indices that the live buffer may still write to without any snapshot seeing it, i.e. the intersection of
+    // the gaps of all snapshots taken
+    int64_t writableBegin;
+    int64_t writableEnd;
+};
+
+// Give up this buffer's storage, freeing it unless snapshots are still using it
+static void ReleaseStorage(Ionl::GapBuffer& buf) {
+    if (!buf.share) {
+        DeallocateBuffer(buf.buffer);
+        return;
+    }
+    if (buf.share->refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        DeallocateBuffer(buf.buffer);
+        delete buf.share;
+    }
+    buf.share = nullptr;
+}
+
+// \return true if the storage is not shared (anymore), in which case it can be written to and reallocated freely
+static bool ClaimStorage(Ionl::GapBuffer& buf) {
+    if (!buf.share) {
+        return true;
+    }
+    // Snapshots can only ever be released, never taken on other threads, so once we are the last user it stays that way
+    if (buf.share->refCount.load(std::memory_order_acquire) == 1) {
+        delete buf.share;
+        buf.share = nullptr;
+        return true;
+    }
+    return false;
+}
+
+// Move to a private copy of the storage, of size `newBufferSize`, with the gap taking up the difference
+static void DetachStorage(Ionl::GapBuffer& buf, int64_t newBufferSize) {
+    int64_t frontSize = buf.GetFrontSize();
+    int64_t backSize = buf.GetBackSize();
+
+    auto newBuffer = AllocateBuffer(newBufferSize);
+    // NOTE: snapshots of empty content may share a null buffer
+    if (buf.buffer) {
+        memcpy(newBuffer, buf.buffer, frontSize * sizeof(ImWchar));
+        memcpy(newBuffer + newBufferSize - backSize, buf.buffer + buf.GetBackBegin(), backSize * sizeof(ImWchar));
+    }
+
+    ReleaseStorage(buf);
+    buf.buffer = newBuffer;
+    buf.bufferSize = newBufferSize;
+    buf.gapSize = newBufferSize - frontSize - backSize;
+}
+
+// Call before writing to buffer indices [begin, end). Buffer indices stay valid.
+static void PrepareWrite(Ionl::GapBuffer& buf, int64_t begin, int64_t end) {
+    if (begin >= end || ClaimStorage(buf)) {
+        return;
+    }
+    if (begin >= buf.share->writableBegin && end <= buf.share->writableEnd) {
+        return;
+    }
+    DetachStorage(buf, buf.bufferSize);
+}
+
 Ionl::GapBuffer::GapBuffer()
     : buffer{ AllocateBuffer(256) }
     , bufferSize{ 256 }
@@ -33,13 +144,36 @@ Ionl::GapBuffer::GapBuffer(std::string_view content)
     UpdateContent(content);
 }
 
+Ionl::GapBuffer::GapBuffer(std::string_view content, bool packed)
+    // NOTE: same as above
+    : buffer{ nullptr }
+    , bufferSize{ 0 }
+    , frontSize{ 0 }
+    , gapSize{ 0 } //
+{
+    if (packed) {
+        UpdateContentPacked(content);
+    } else {
+        UpdateContent(content);
+    }
+}
+
 Ionl::GapBuffer::GapBuffer(GapBuffer&& that) noexcept
     : buffer{ that.buffer }
     , bufferSize{ that.bufferSize }
     , frontSize{ that.frontSize }
-    , gapSize{ that.gapSize } //
+    , gapSize{ that.gapSize }
+    , frontNewlines{ std::move(that.frontNewlines) }
+    , backNewlines{ std::move(that.backNewlines) }
+    , packed{ std::move(that.packed) }
+    , share{ that.share }
+    , undoJournal{ std::move(that.undoJournal) }
+    , unchangedPrefix{ that.unchangedPrefix }
+    , unchangedSuffix{ that.unchangedSuffix }
+    , isDirty{ that.isDirty } //
 {
     that.buffer = nullptr;
+    that.share = nullptr;
     that.bufferSize = 0;
     that.frontSize = 0;
     that.gapSize = 0;
@@ -50,17 +184,25 @@ Ionl::GapBuffer& Ionl::GapBuffer::operator=(GapBuffer&& that) noexcept {
         return *this;
     }
 
-    DeallocateBuffer(this->buffer);
+    ReleaseStorage(*this);
     this->buffer = std::exchange(that.buffer, nullptr);
     this->bufferSize = std::exchange(that.bufferSize, 0);
     this->frontSize = std::exchange(that.frontSize, 0);
     this->gapSize = std::exchange(that.gapSize, 0);
+    this->frontNewlines = std::move(that.frontNewlines);
+    this->backNewlines = std::move(that.backNewlines);
+    this->packed = std::move(that.packed);
+    this->share = std::exchange(that.share, nullptr);
+    this->undoJournal = std::move(that.undoJournal);
+    this->unchangedPrefix = that.unchangedPrefix;
+    this->unchangedSuffix = that.unchangedSuffix;
+    this->isDirty = that.isDirty;
 
     return *this;
 }
 
 Ionl::GapBuffer::~GapBuffer() {
-    DeallocateBuffer(buffer);
+    ReleaseStorage(*this);
 }
 
 int64_t Ionl::GapBuffer::GetLastTextIndex() const {
@@ -73,40 +215,202 @@ int64_t Ionl::GapBuffer::GetLastTextEnd() const {
     return GetBackSize() > 0 ? GetBackEnd() : GetFrontEnd();
 }
 
+void Ionl::GapBuffer::Pack() {
+    if (packed) return;
+
+    auto content = MakePackedContent(ExtractContent());
+    ReleaseStorage(*this);
+    buffer = nullptr;
+    bufferSize = 0;
+    frontSize = 0;
+    gapSize = 0;
+    frontNewlines = {};
+    backNewlines = {};
+    packed = std::move(content);
+}
+
+void Ionl::GapBuffer::Unpack() {
+    if (!packed) return;
+    assert(packed->fitsImWchar);
+
+    auto content = std::move(packed);
+    // Same content, the history stays valid
+    auto journal = std::move(undoJournal);
+    UpdateContent(content->utf8);
+    undoJournal = std::move(journal);
+}
+
 std::string Ionl::GapBuffer::ExtractContent() const {
+    std::string result;
+    ExtractContent(result);
+    return result;
+}
+
+void Ionl::GapBuffer::ExtractContent(std::string& out) const {
+    if (packed) {
+        // Already in the on-disk format, no transcoding needed
+        out = packed->utf8;
+        return;
+    }
+
     auto frontBegin = buffer;
     auto frontEnd = buffer + frontSize;
     auto backBegin = buffer + frontSize + gapSize;
     auto backEnd = buffer + bufferSize;
 
-    size_t utf8Count =
-        ImTextCountUtf8BytesFromStr(frontBegin, frontEnd) +
-        ImTextCountUtf8BytesFromStr(backBegin, backEnd);
-
-    // Add 1 to string buffer size to account for null terminator
-    // ImTextStrToUtf8() writes the \0 at the end, in addition to the provided source content
-    std::string result(utf8Count, '\0');
-    size_t frontUtf8Count = ImTextStrToUtf8(result.data(), result.size() + 1, frontBegin, frontEnd);
-    size_t backUtf8Count = ImTextStrToUtf8(result.data() + frontUtf8Count, result.size() - frontUtf8Count + 1, backBegin, backEnd);
+    size_t utf8Count = Utf8CountBytes(frontBegin, frontEnd) + Utf8CountBytes(backBegin, backEnd);
 
-    return result;
+    // NOTE: this only allocates if `out` doesn't have enough capacity already
+    out.resize_and_overwrite(utf8Count, [&](char* p, size_t) {
+        auto frontUtf8Count = Utf8Encode(p, frontBegin, frontEnd);
+        auto backUtf8Count = Utf8Encode(p + frontUtf8Count, backBegin, backEnd);
+        return frontUtf8Count + backUtf8Count;
+    });
 }
 
 void Ionl::GapBuffer::UpdateContent(std::string_view content) {
+    packed.reset();
+    if (undoJournal) {
+        undoJournal->Clear();
+    }
+    isDirty = true;
+    unchangedPrefix = 0;
+    unchangedSuffix = 0;
+
     auto strBegin = content.data();
     auto strEnd = content.data() + content.size();
-    auto minBufferSize = ImTextCountCharsFromUtf8(strBegin, strEnd);
-    if (bufferSize < minBufferSize) {
-        bufferSize = minBufferSize;
-        frontSize = minBufferSize;
-        gapSize = 0;
-        ReallocateBuffer(buffer, minBufferSize);
-    } else {
-        // If new string size is smaller than our current buffer, we keep the buffer and simply put new data into it
-        frontSize = minBufferSize;
-        gapSize = bufferSize - minBufferSize;
+
+    // Each codepoint takes at least 1 byte, so the byte count is an upper bound on the number of ImWchar's needed.
+    // Decoding straight into a buffer of that size saves us a counting pass over the content.
+    auto maxBufferSize = (int64_t)content.size();
+    bool grew = false;
+    if (bufferSize < maxBufferSize || !ClaimStorage(*this)) {
+        // Old content is getting overwritten anyways, no point in having it copied over by a reallocation
+        ReleaseStorage(*this);
+        bufferSize = maxBufferSize;
+        buffer = AllocateBuffer(bufferSize);
+        grew = true;
+    }
+    // If new string size is smaller than our current buffer, we keep the buffer and simply put new data into it
+    int64_t numCodepoints = Utf8Decode(buffer, bufferSize, strBegin, strEnd);
+    frontSize = numCodepoints;
+    gapSize = bufferSize - numCodepoints;
+
+    frontNewlines.clear();
+    backNewlines.clear();
+    AppendNewlines(frontNewlines, buffer, buffer + numCodepoints, 0);
+
+    // For non-ASCII content the upper bound overshoots (up to 3x for CJK), give the excess back if we allocated it just now
+    if (grew && numCodepoints > 0) {
+        int64_t fitBufferSize = numCodepoints;
+        if (fitBufferSize < bufferSize) {
+            ReallocateBuffer(buffer, fitBufferSize);
+            bufferSize = fitBufferSize;
+            gapSize = fitBufferSize - numCodepoints;
+        }
+    }
+}
+
+void Ionl::GapBuffer::UpdateContentPacked(std::string_view content) {
+    if (undoJournal) {
+        undoJournal->Clear();
+    }
+    isDirty = true;
+    unchangedPrefix = 0;
+    unchangedSuffix = 0;
+    ReleaseStorage(*this);
+    buffer = nullptr;
+    bufferSize = 0;
+    frontSize = 0;
+    gapSize = 0;
+    frontNewlines = {};
+    backNewlines = {};
+    packed = MakePackedContent(std::string(content));
+}
+
+int64_t Ionl::MapLogicalIndexToUtf8Offset(const PackedUtf8Content& content, int64_t logicalIdx) {
+    if (content.IsAscii()) {
+        return logicalIdx;
+    }
+
+    auto strBegin = content.utf8.data();
+    auto strEnd = content.utf8.data() + content.utf8.size();
+
+    int64_t checkpoint = logicalIdx / kPackedIndexStride;
+    if (checkpoint >= (int64_t)content.codepointOffsets.size()) {
+        // Only possible for logicalIdx == codepointCount where it's at a stride boundary, i.e. the end of content
+        return (int64_t)content.utf8.size();
+    }
+
+    auto p = strBegin + content.codepointOffsets[checkpoint];
+    for (int64_t i = checkpoint * kPackedIndexStride; i < logicalIdx && p < strEnd; ++i) {
+        unsigned int c;
+        p += ImTextCharFromUtf8(&c, p, strEnd);
+    }
+    return p - strBegin;
+}
+
+int64_t Ionl::MapUtf8OffsetToLogicalIndex(const PackedUtf8Content& content, int64_t utf8Offset) {
+    if (content.IsAscii()) {
+        return utf8Offset;
+    }
+
+    auto strBegin = content.utf8.data();
+    auto strEnd = content.utf8.data() + content.utf8.size();
+
+    // Find the last checkpoint at or before `utf8Offset`
+    auto it = std::upper_bound(content.codepointOffsets.begin(), content.codepointOffsets.end(), (uint32_t)utf8Offset);
+    int64_t checkpoint = (it - content.codepointOffsets.begin()) - 1;
+
+    int64_t logicalIdx = checkpoint * kPackedIndexStride;
+    auto p = strBegin + content.codepointOffsets[checkpoint];
+    auto target = strBegin + utf8Offset;
+    while (p < target && p < strEnd) {
+        unsigned int c;
+        p += ImTextCharFromUtf8(&c, p, strEnd);
+        logicalIdx += 1;
+    }
+    return logicalIdx;
+}
+
+// Logical index of the k-th '\n' in the whole text
+static int64_t GetNewlinePosition(const Ionl::GapBuffer& buf, int64_t k) {
+    auto frontCount = (int64_t)buf.frontNewlines.size();
+    if (k < frontCount) {
+        return buf.frontNewlines[k];
     }
-    ImTextStrFromUtf8NoNullTerminate(buffer, bufferSize, strBegin, strEnd);
+    // backNewlines is ordered from the end of content towards the gap
+    int64_t distanceFromEnd = buf.backNewlines[buf.backNewlines.size() - 1 - (k - frontCount)];
+    return buf.GetContentSize() - distanceFromEnd;
+}
+
+int64_t Ionl::GetParagraphCount(const GapBuffer& buf) {
+    return (int64_t)(buf.frontNewlines.size() + buf.backNewlines.size()) + 1;
+}
+
+int64_t Ionl::FindParagraphContaining(const GapBuffer& buf, int64_t logicalIdx) {
+    if (logicalIdx <= buf.frontSize) {
+        return std::lower_bound(buf.frontNewlines.begin(), buf.frontNewlines.end(), logicalIdx) - buf.frontNewlines.begin();
+    }
+
+    // Number of newlines in back that are before `logicalIdx`, i.e. further away from the end of content than it is
+    int64_t distanceFromEnd = buf.GetContentSize() - logicalIdx;
+    auto it = std::upper_bound(buf.backNewlines.begin(), buf.backNewlines.end(), distanceFromEnd);
+    return (int64_t)buf.frontNewlines.size() + (buf.backNewlines.end() - it);
+}
+
+int64_t Ionl::GetParagraphBegin(const GapBuffer& buf, int64_t paragraph) {
+    if (paragraph <= 0) {
+        return 0;
+    }
+    return GetNewlinePosition(buf, paragraph - 1) + 1;
+}
+
+int64_t Ionl::GetParagraphEnd(const GapBuffer& buf, int64_t paragraph) {
+    if (paragraph >= GetParagraphCount(buf) - 1) {
+        return buf.GetContentSize();
+    }
+    return GetNewlinePosition(buf, paragraph);
 }
 
 int64_t Ionl::MapLogicalIndexToBufferIndex(const GapBuffer& buffer, int64_t logicalIdx) {
@@ -165,7 +469,15 @@ void Ionl::MoveGapToBufferIndex(Ionl::GapBuffer& buf, int64_t newIdx) {
             newIdx = buf.bufferSize - buf.gapSize;
         }
         size_t size = newIdx - oldIdx;
+        PrepareWrite(buf, oldIdx, newIdx);
         memmove(buf.buffer + oldIdx, buf.buffer + buf.GetBackBegin(), size * sizeof(ImWchar));
+
+        // Newlines that moved from back to front
+        int64_t contentSize = buf.GetContentSize();
+        while (!buf.backNewlines.empty() && contentSize - buf.backNewlines.back() < newIdx) {
+            buf.frontNewlines.push_back(contentSize - buf.backNewlines.back());
+            buf.backNewlines.pop_back();
+        }
     } else /* oldIdx > newIdx */ {
         // Moving towards beginning of buffer
 
@@ -183,7 +495,15 @@ void Ionl::MoveGapToBufferIndex(Ionl::GapBuffer& buf, int64_t newIdx) {
             newIdx = 0;
         }
         size_t size = oldIdx - newIdx;
+        PrepareWrite(buf, buf.GetGapEnd() - size, buf.GetGapEnd());
         memmove(buf.buffer + buf.GetGapEnd() - size, buf.buffer + newIdx, size * sizeof(ImWchar));
+
+        // Newlines that moved from front to back
+        int64_t contentSize = buf.GetContentSize();
+        while (!buf.frontNewlines.empty() && buf.frontNewlines.back() >= newIdx) {
+            buf.backNewlines.push_back(contentSize - buf.frontNewlines.back());
+            buf.frontNewlines.pop_back();
+        }
     }
     buf.frontSize = newIdx;
 }
@@ -209,17 +529,32 @@ void Ionl::WidenGap(Ionl::GapBuffer& buf, size_t requestedGapSize) {
     // - Increasing the gap size means the user is editing this buffer, which means they'll probably edit it some more
     // - Hence, it's likely that this buffer will be reallocated multiple times in the future
     // - Hence, we round buffer size to a power of 2 to reduce malloc() overhead
+    // - But for large buffers, doubling means up to half of the memory sits unused in the gap, so above a threshold we
+    //   only grow by a fraction of the content size. This is still geometric growth, so amortized O(1) per insertion.
+
+    // The sizing below starts from the content size, so for a gap that is already wide enough it would shrink the buffer
+    if ((int64_t)requestedGapSize <= buf.GetGapSize()) {
+        return;
+    }
 
     int64_t frontSize = buf.GetFrontSize();
     int64_t backSize = buf.GetBackSize();
     // `GapBuffer::gapSize` will be updated as a result of this function call
     int64_t oldGapSize = buf.GetGapSize();
 
-    int64_t newBufSize = ImUpperPowerOfTwo(buf.bufferSize);
     int64_t minimumBufSize = buf.GetContentSize() + requestedGapSize;
-    // TODO keep a reasonable size once we get above e.g. 8KB?
-    while (newBufSize < minimumBufSize) {
-        newBufSize *= 2;
+    int64_t newBufSize;
+    if (minimumBufSize <= kGapGrowthTaperThreshold) {
+        newBufSize = ImMax<int64_t>(ImUpperPowerOfTwo(minimumBufSize), kMinimumGapBufferSize);
+    } else {
+        newBufSize = minimumBufSize + buf.GetContentSize() / 8;
+        newBufSize = (newBufSize + kGapGrowthTaperStep - 1) / kGapGrowthTaperStep * kGapGrowthTaperStep;
+    }
+
+    if (!ClaimStorage(buf)) {
+        // Copying into a new allocation is needed anyways, which might as well leave the gap in the right place
+        DetachStorage(buf, newBufSize);
+        return;
     }
 
     ReallocateBuffer(buf.buffer, newBufSize);
@@ -234,6 +569,47 @@ void Ionl::WidenGap(Ionl::GapBuffer& buf, size_t requestedGapSize) {
         backSize * sizeof(ImWchar));
 }
 
+int64_t Ionl::ShrinkGapToFit(GapBuffer& buf, int64_t keptGapSize) {
+    if (buf.packed) return 0;
+    // Snapshots keep the storage alive regardless, shrinking would only add a copy
+    if (!ClaimStorage(buf)) return 0;
+
+    int64_t frontSize = buf.GetFrontSize();
+    int64_t backSize = buf.GetBackSize();
+    int64_t contentSize = frontSize + backSize;
+
+    int64_t newBufSize = contentSize + keptGapSize;
+    if (newBufSize >= buf.bufferSize) {
+        return 0;
+    }
+    int64_t newGapSize = newBufSize - contentSize;
+
+    // Move back to its new location first, while the old buffer is still intact
+    memmove(
+        /*New back's location*/ buf.buffer + frontSize + newGapSize,
+        /*Old back*/ buf.buffer + frontSize + buf.gapSize,
+        backSize * sizeof(ImWchar));
+
+    int64_t trimmedBytes = (buf.bufferSize - newBufSize) * (int64_t)sizeof(ImWchar);
+    ReallocateBuffer(buf.buffer, newBufSize);
+    buf.bufferSize = newBufSize;
+    buf.gapSize = newGapSize;
+
+    return trimmedBytes;
+}
+
+// Record that everything between the first `unchangedPrefix` and the last `unchangedSuffix` characters got edited
+static void MarkDirty(Ionl::GapBuffer& buf, int64_t unchangedPrefix, int64_t unchangedSuffix) {
+    if (buf.isDirty) {
+        buf.unchangedPrefix = std::min(buf.unchangedPrefix, unchangedPrefix);
+        buf.unchangedSuffix = std::min(buf.unchangedSuffix, unchangedSuffix);
+    } else {
+        buf.unchangedPrefix = unchangedPrefix;
+        buf.unchangedSuffix = unchangedSuffix;
+        buf.isDirty = true;
+    }
+}
+
 void Ionl::InsertAtGap(GapBuffer& buf, const ImWchar* text, size_t size) {
     if (buf.GetGapSize() <= size) {
         // Add 1 to void having a 0-length gap
@@ -241,21 +617,36 @@ void Ionl::InsertAtGap(GapBuffer& buf, const ImWchar* text, size_t size) {
     }
 
     assert(buf.gapSize > size);
+    PrepareWrite(buf, buf.GetGapBegin(), buf.GetGapBegin() + size);
     memcpy(buf.buffer + buf.GetGapBegin(), text, size * sizeof(ImWchar));
+    AppendNewlines(buf.frontNewlines, text, text + size, buf.frontSize);
+    if (buf.undoJournal) {
+        RecordEdit(*buf.undoJournal, buf.frontSize, nullptr, 0, text, size);
+    }
+    MarkDirty(buf, buf.frontSize, buf.GetBackSize());
     buf.frontSize += size;
     buf.gapSize -= size;
 }
 
 void Ionl::InsertAtGap(GapBuffer& buf, const char* text, size_t size) {
-    auto numCodepoint = ImTextCountCharsFromUtf8(text, text + size);
-    if (buf.GetBackSize() <= numCodepoint) {
-        WidenGap(buf, numCodepoint + 1);
+    // Byte count is an upper bound on the number of codepoints, so we can decode straight into the gap in a single pass
+    if (buf.GetGapSize() <= (int64_t)size) {
+        WidenGap(buf, size + 1);
     }
 
-    assert(buf.gapSize > numCodepoint);
+    // The decoder may use all of the capacity it is given as scratch space
+    PrepareWrite(buf, buf.GetGapBegin(), buf.GetGapEnd());
+
     const char* remaining;
-    ImTextStrFromUtf8NoNullTerminate(buf.buffer + buf.GetGapBegin(), buf.gapSize, text, text + size, &remaining);
-    assert(remaining == text + size);
+    auto numCodepoint = Utf8Decode(buf.buffer + buf.GetGapBegin(), buf.gapSize, text, text + size, &remaining);
+    assert(remaining == text + size || *remaining == '\0');
+    assert(buf.gapSize > numCodepoint);
+    auto inserted = buf.buffer + buf.GetGapBegin();
+    AppendNewlines(buf.frontNewlines, inserted, inserted + numCodepoint, buf.frontSize);
+    if (buf.undoJournal) {
+        RecordEdit(*buf.undoJournal, buf.frontSize, nullptr, 0, inserted, numCodepoint);
+    }
+    MarkDirty(buf, buf.frontSize, buf.GetBackSize());
     buf.frontSize += numCodepoint;
     buf.gapSize -= numCodepoint;
 }
@@ -263,23 +654,228 @@ void Ionl::InsertAtGap(GapBuffer& buf, const char* text, size_t size) {
 bool Ionl::DeleteFromGap(GapBuffer& buf, int64_t offset) {
     if (offset < 0) {
         // Don't delete past buffer begin
-        if (-offset < buf.GetFrontSize()) {
+        if (-offset <= buf.GetFrontSize()) {
+            if (buf.undoJournal) {
+                RecordEdit(*buf.undoJournal, buf.frontSize + offset, buf.buffer + buf.frontSize + offset, -offset, nullptr, 0);
+            }
+            MarkDirty(buf, buf.frontSize + offset, buf.GetBackSize());
             buf.frontSize += offset;
             buf.gapSize -= offset;
+            while (!buf.frontNewlines.empty() && buf.frontNewlines.back() >= buf.frontSize) {
+                buf.frontNewlines.pop_back();
+            }
             return true;
         }
         return false;
     } else {
         // Don't delete past buffer end
-        if (offset < buf.GetBackSize()) {
+        if (offset <= buf.GetBackSize()) {
+            if (buf.undoJournal) {
+                RecordEdit(*buf.undoJournal, buf.frontSize, buf.buffer + buf.GetBackBegin(), offset, nullptr, 0);
+            }
+            // Distance from end of content of the first character that survives
+            int64_t survivorDistance = buf.GetBackSize() - offset;
+            MarkDirty(buf, buf.frontSize, survivorDistance);
             buf.gapSize += offset;
+            while (!buf.backNewlines.empty() && buf.backNewlines.back() > survivorDistance) {
+                buf.backNewlines.pop_back();
+            }
             return true;
         }
         return false;
     }
 }
 
+void Ionl::ApplyEdits(GapBuffer& buf, std::span<GapBufferEdit> edits, std::span<int64_t> positions) {
+    if (edits.empty()) return;
+
+    // Stable, so that multiple insertions at the same position keep their given order. A pure insertion sorts before a
+    // replacement that begins at the same position.
+    std::stable_sort(edits.begin(), edits.end(), [](const GapBufferEdit& a, const GapBufferEdit& b) {
+        return a.begin != b.begin ? a.begin < b.begin : a.end < b.end;
+    });
+
+    int64_t contentSize = buf.GetContentSize();
+    // prefixDelta[k] is the size change caused by the first k edits
+    std::vector<int64_t> prefixDelta(edits.size() + 1);
+    for (size_t k = 0; k < edits.size(); ++k) {
+        auto& edit = edits[k];
+        assert(edit.begin <= edit.end && edit.end <= contentSize);
+        assert(k == 0 || edits[k - 1].end <= edit.begin);
+        prefixDelta[k + 1] = prefixDelta[k] + (int64_t)edit.textSize - (edit.end - edit.begin);
+    }
+
+    if (auto journal = buf.undoJournal.get()) {
+        // Recorded as if the edits were applied one by one, first to last, which is what each entry's position is
+        // relative to. Multiple edits form one undo step.
+        bool isGroup = edits.size() > 1;
+        if (isGroup) journal->BeginGroup();
+        std::vector<ImWchar> removed;
+        for (size_t k = 0; k < edits.size(); ++k) {
+            auto& edit = edits[k];
+            removed.clear();
+            for (int64_t i = edit.begin; i < edit.end; ++i) {
+                removed.push_back(buf[i]);
+            }
+            RecordEdit(*journal, edit.begin + prefixDelta[k], removed.data(), removed.size(), edit.text, edit.textSize);
+        }
+        if (isGroup) journal->EndGroup();
+    }
+
+    for (auto& pos : positions) {
+        // Since edits are sorted and don't overlap, their ends are sorted too
+        size_t k = std::partition_point(edits.begin(), edits.end(), [&](const GapBufferEdit& e) { return e.end <= pos; }) - edits.begin();
+        if (k < edits.size() && edits[k].begin < pos) {
+            pos = edits[k].begin + prefixDelta[k] + (int64_t)edits[k].textSize;
+        } else {
+            pos += prefixDelta[k];
+        }
+    }
+
+    // The edited text is produced by a single sweep over the range of text covered by the edits, in place: the output is
+    // written into the gap, one end of it growing into the text that has already been read. We sweep from whichever end
+    // of that range the gap is closer to, so that getting the gap there first costs as little as possible.
+    int64_t firstBegin = edits.front().begin;
+    int64_t lastEnd = edits.back().end;
+    MarkDirty(buf, firstBegin, contentSize - lastEnd);
+    int64_t gapPos = buf.GetGapBegin();
+    bool forward = std::abs(gapPos - firstBegin) <= std::abs(gapPos - lastEnd);
+
+    // To never overwrite text that hasn't been read yet, the gap has to be able to absorb the largest size increase at
+    // any point during the sweep
+    int64_t maxGrowth = 0;
+    for (size_t k = 0; k <= edits.size(); ++k) {
+        int64_t growth = forward ? prefixDelta[k] : prefixDelta.back() - prefixDelta[k];
+        maxGrowth = ImMax(maxGrowth, growth);
+    }
+
+    if (forward) {
+        MoveGapToLogicalIndex(buf, firstBegin);
+    } else {
+        MoveGapToLogicalIndex(buf, lastEnd);
+    }
+    if (buf.gapSize <= maxGrowth) {
+        WidenGap(buf, maxGrowth + 1);
+    }
+
+    int64_t outputSize = (lastEnd - firstBegin) + prefixDelta.back();
+    if (forward) {
+        PrepareWrite(buf, buf.GetGapBegin(), buf.GetGapBegin() + outputSize);
+    } else {
+        PrepareWrite(buf, buf.GetGapEnd() - outputSize, buf.GetGapEnd());
+    }
+
+    if (forward) {
+        // Everything covered by the edits is in back, where logical index `i` is at buffer index `i + gapSize`.
+        // Output grows from gap begin towards the end of the buffer.
+        int64_t gapSize = buf.gapSize;
+        ImWchar* out = buf.buffer + buf.frontSize;
+        int64_t reader = firstBegin;
+
+        for (auto& edit : edits) {
+            // Newlines that are read go from back to front, unless they are being replaced
+            // NOTE: back newlines after the last edit stay valid as-is, since their distance from the end doesn't change
+            while (!buf.backNewlines.empty() && contentSize - buf.backNewlines.back() < edit.end) {
+                int64_t oldIdx = contentSize - buf.backNewlines.back();
+                if (oldIdx < edit.begin) {
+                    buf.frontNewlines.push_back((out - buf.buffer) + (oldIdx - reader));
+                }
+                buf.backNewlines.pop_back();
+            }
+
+            int64_t unchangedSize = edit.begin - reader;
+            memmove(out, buf.buffer + reader + gapSize, unchangedSize * sizeof(ImWchar));
+            out += unchangedSize;
+
+            // NOTE: pure deletions may have a null `text`, which memcpy() doesn't allow even for 0 bytes
+            if (edit.textSize > 0) {
+                memcpy(out, edit.text, edit.textSize * sizeof(ImWchar));
+            }
+            AppendNewlines(buf.frontNewlines, out, out + edit.textSize, out - buf.buffer);
+            out += edit.textSize;
+
+            reader = edit.end;
+        }
+
+        int64_t newFrontSize = out - buf.buffer;
+        buf.gapSize = (reader + gapSize) - newFrontSize;
+        buf.frontSize = newFrontSize;
+    } else {
+        // Everything covered by the edits is in front, where logical index == buffer index.
+        // Output grows from gap end towards the beginning of the buffer.
+        ImWchar* out = buf.buffer + buf.GetBackBegin();
+        int64_t reader = lastEnd;
+        auto distanceFromEnd = [&](const ImWchar* p) { return buf.bufferSize - (p - buf.buffer); };
+
+        for (size_t k = edits.size(); k-- > 0;) {
+            auto& edit = edits[k];
+
+            // Newlines that are read go from front to back, unless they are being replaced
+            // NOTE: front newlines before the first edit stay valid as-is
+            ImWchar* unchangedOut = out - (reader - edit.end);
+            while (!buf.frontNewlines.empty() && buf.frontNewlines.back() >= edit.begin) {
+                int64_t oldIdx = buf.frontNewlines.back();
+                if (oldIdx >= edit.end) {
+                    buf.backNewlines.push_back(distanceFromEnd(unchangedOut + (oldIdx - edit.end)));
+                }
+                buf.frontNewlines.pop_back();
+            }
+
+            int64_t unchangedSize = reader - edit.end;
+            out -= unchangedSize;
+            memmove(out, buf.buffer + edit.end, unchangedSize * sizeof(ImWchar));
+
+            out -= edit.textSize;
+            if (edit.textSize > 0) {
+                memcpy(out, edit.text, edit.textSize * sizeof(ImWchar));
+            }
+            for (auto p = out + edit.textSize; p-- != out;) {
+                if (*p == '\n') {
+                    buf.backNewlines.push_back(distanceFromEnd(p));
+                }
+            }
+
+            reader = edit.begin;
+        }
+
+        buf.frontSize = firstBegin;
+        buf.gapSize = (out - buf.buffer) - firstBegin;
+    }
+}
+
+std::shared_ptr<const Ionl::GapBuffer> Ionl::TakeSnapshot(GapBuffer& buf) {
+    // NOTE: empty content doesn't allocate anything
+    auto snapshot = std::make_shared<GapBuffer>(std::string_view());
+
+    if (buf.packed) {
+        snapshot->packed = std::make_unique<PackedUtf8Content>(*buf.packed);
+        return snapshot;
+    }
+
+    if (ClaimStorage(buf)) {
+        buf.share = new GapBufferShare{ 1, buf.GetGapBegin(), buf.GetGapEnd() };
+    } else {
+        buf.share->writableBegin = ImMax(buf.share->writableBegin, buf.GetGapBegin());
+        buf.share->writableEnd = ImMin(buf.share->writableEnd, buf.GetGapEnd());
+    }
+    buf.share->refCount.fetch_add(1, std::memory_order_relaxed);
+
+    snapshot->buffer = buf.buffer;
+    snapshot->bufferSize = buf.bufferSize;
+    snapshot->frontSize = buf.frontSize;
+    snapshot->gapSize = buf.gapSize;
+    snapshot->frontNewlines = buf.frontNewlines;
+    snapshot->backNewlines = buf.backNewlines;
+    snapshot->share = buf.share;
+    return snapshot;
+}
+
 void Ionl::DumpGapBuffer(const Ionl::GapBuffer& buf, std::ostream& out) {
+    if (buf.packed) {
+        out << "[packed] " << buf.packed->utf8;
+        return;
+    }
+
     for (int64_t i = buf.GetFrontBegin(); i < buf.GetFrontEnd(); ++i) {
         char utf8[5];
         int count = ImTextCharToUtf8Counted(utf8, buf.buffer[i]);
@@ -296,6 +892,12 @@ void Ionl::DumpGapBuffer(const Ionl::GapBuffer& buf, std::ostream& out) {
 }
 
 void Ionl::ShowGapBuffer(const Ionl::GapBuffer& buf) {
+    if (buf.packed) {
+        ImGui::Text("[packed, %lld codepoints, %zu bytes]", (long long)buf.packed->codepointCount, buf.packed->utf8.size());
+        ImGui::TextWrapped("%s", buf.packed->utf8.c_str());
+        return;
+    }
+
     // Select a monospace font
     auto monospaceFont = ImGui::GetDefaultFont();
     auto window = ImGui::GetCurrentWindow();
@@ -5,15 +5,44 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <ostream>
+#include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace Ionl {
 
 template <typename TContainer>
 struct GapBufferIterator;
 
+struct GapBufferShare;
+struct UndoJournal;
+
+/// WidenGap() doubles the buffer size until it reaches this many characters, and grows by 1/8 of content size after that
+constexpr int64_t kGapGrowthTaperThreshold = 8192;
+/// Past kGapGrowthTaperThreshold, buffer sizes are rounded up to a multiple of this
+constexpr int64_t kGapGrowthTaperStep = 2048;
+constexpr int64_t kMinimumGapBufferSize = 16;
+
+/// Number of codepoints between two entries in PackedUtf8Content::codepointOffsets
+constexpr int64_t kPackedIndexStride = 64;
+
+/// Compact, read-only form of a GapBuffer's content, stored exactly as it is in the database.
+struct PackedUtf8Content {
+    std::string utf8;
+    // codepointOffsets[k] is the byte offset of codepoint `k * kPackedIndexStride`
+    // Left empty if the content is pure ASCII, in which case logical index == byte offset
+    std::vector<uint32_t> codepointOffsets;
+    int64_t codepointCount = 0;
+    // False if unpacking would replace some of the text with U+FFFD, i.e. characters outside the BMP (which don't fit
+    // in an ImWchar) or invalid UTF-8. Such content has to stay packed, or saving it would lose those characters.
+    bool fitsImWchar = true;
+
+    bool IsAscii() const { return codepointOffsets.empty(); }
+};
+
 struct GapBuffer {
     using iterator = GapBufferIterator<GapBuffer>;
     using const_iterator = GapBufferIterator<const GapBuffer>;
@@ -23,8 +52,37 @@ struct GapBuffer {
     int64_t frontSize;
     int64_t gapSize;
 
+    // Positions of all '\n' in the text, kept up to date by the free functions below. Split at the gap the same way the
+    // text is, so that edits only ever touch the newlines next to the gap:
+    // - frontNewlines: logical index of each '\n' in front, in ascending order
+    // - backNewlines: distance from the end of content (i.e. `GetContentSize() - <logical index>`) of each '\n' in back,
+    //   in ascending order. This is unaffected by edits in front, and the end of the vector is closest to the gap.
+    std::vector<int64_t> frontNewlines;
+    std::vector<int64_t> backNewlines;
+
+    // When non-null, the buffer is in "packed" mode: `buffer` is not allocated, and the content lives here as UTF-8.
+    // This is meant for bullets that are loaded but not being displayed or edited, to save both the memory of a wide
+    // character array and the transcoding on load and save. Call Unpack() before using anything that touches `buffer`.
+    std::unique_ptr<PackedUtf8Content> packed;
+
+    // Non-null while `buffer` is shared with snapshots, see TakeSnapshot(). Writes that would be visible to a snapshot
+    // make this buffer move to its own copy of the storage first.
+    GapBufferShare* share = nullptr;
+
+    // When non-null, every edit made through InsertAtGap(), DeleteFromGap() and ApplyEdits() is recorded here. Replacing
+    // the whole content with UpdateContent()/UpdateContentPacked() clears it.
+    std::unique_ptr<UndoJournal> undoJournal;
+
+    // Extent of the edits made since the last ResetDirtyRange(), so that derived data (e.g. TextBuffer::textRuns) can be
+    // recomputed for only the part that changed. When `isDirty`, the first `unchangedPrefix` and the last
+    // `unchangedSuffix` characters of content are the same as they were at the time of the reset.
+    int64_t unchangedPrefix = 0;
+    int64_t unchangedSuffix = 0;
+    bool isDirty = true;
+
     GapBuffer();
     GapBuffer(std::string_view content);
+    GapBuffer(std::string_view content, bool packed);
     GapBuffer(GapBuffer&&) noexcept;
     GapBuffer& operator=(GapBuffer&&) noexcept;
     ~GapBuffer();
@@ -46,7 +104,14 @@ struct GapBuffer {
     const ImWchar* PtrCBegin() const { return buffer; }
     const ImWchar* PtrCEnd() const { return buffer + bufferSize; }
 
-    int64_t GetContentSize() const { return bufferSize - gapSize; }
+    int64_t GetContentSize() const { return packed ? packed->codepointCount : bufferSize - gapSize; }
+
+    bool IsPacked() const { return packed != nullptr; }
+    /// Convert content to packed mode, freeing the wide character buffer.
+    void Pack();
+    /// Convert content back to a regular gap buffer. No-op if not packed. Requires CanUnpack().
+    void Unpack();
+    bool CanUnpack() const { return !packed || packed->fitsImWchar; }
 
     /// Find the index to the last valid character in buffer.
     /// If there is no valid text in buffer at all, return 0.
@@ -66,13 +131,37 @@ struct GapBuffer {
     int64_t GetBackEnd() const { return bufferSize; }
     int64_t GetBackSize() const { return GetBackEnd() - GetBackBegin(); }
 
-    const ImWchar& operator[](size_t i) const { return i > (size_t)frontSize ? buffer[i + gapSize] : buffer[i]; }
+    const ImWchar& operator[](size_t i) const { return i >= (size_t)frontSize ? buffer[i + gapSize] : buffer[i]; }
     ImWchar& operator[](size_t i) { return const_cast<ImWchar&>(const_cast<const GapBuffer&>(*this)[i]); }
 
+    void ResetDirtyRange() { isDirty = false; }
+
     std::string ExtractContent() const;
+    /// Same as ExtractContent(), but writes into `out` (replacing its content) so that its capacity can be reused.
+    void ExtractContent(std::string& out) const;
     void UpdateContent(std::string_view content);
+    void UpdateContentPacked(std::string_view content);
 };
 
+/// Map a logical (codepoint) index to a byte offset in `PackedUtf8Content::utf8`.
+/// Uses the sparse index, so this costs at most `kPackedIndexStride` steps of UTF-8 decoding.
+int64_t MapLogicalIndexToUtf8Offset(const PackedUtf8Content& content, int64_t logicalIdx);
+/// Inverse of MapLogicalIndexToUtf8Offset(). `utf8Offset` must point at the beginning of a codepoint.
+int64_t MapUtf8OffsetToLogicalIndex(const PackedUtf8Content& content, int64_t utf8Offset);
+
+// NOTE: all of the functions below require the buffer to be unpacked, except DumpGapBuffer() and ShowGapBuffer()
+
+// A paragraph is a range of text separated by '\n'. The '\n' itself is considered to be at the end of the paragraph
+// before it. All of these are O(log n) lookups into the newline index.
+
+int64_t GetParagraphCount(const GapBuffer& buf);
+/// \return Index of the paragraph containing the logical index, i.e. the number of '\n' before it.
+int64_t FindParagraphContaining(const GapBuffer& buf, int64_t logicalIdx);
+/// \return Logical index of the first character in the paragraph.
+int64_t GetParagraphBegin(const GapBuffer& buf, int64_t paragraph);
+/// \return Logical index of the '\n' ending the paragraph, or content size for the last paragraph.
+int64_t GetParagraphEnd(const GapBuffer& buf, int64_t paragraph);
+
 int64_t MapLogicalIndexToBufferIndex(const GapBuffer& buffer, int64_t logicalIdx);
 
 // If the buffer index does not point to a valid logical location (i.e. it points to somewhere in the gap), -1 is returned
@@ -87,6 +176,9 @@ void MoveGapToBufferIndex(GapBuffer& buf, int64_t newIdxBuffer);
 // In other words, `newIdx` will become the first element in the back buffer.
 void MoveGapToLogicalIndex(GapBuffer& buf, int64_t newIdxLogical);
 void WidenGap(GapBuffer& buf, size_t requestedGapSize = 0);
+/// Shrink the buffer such that the gap is only about `keptGapSize` large. Meant for buffers that are not being edited.
+/// \return Number of bytes given back to the allocator, or 0 if the buffer is already small enough.
+int64_t ShrinkGapToFit(GapBuffer& buf, int64_t keptGapSize = kMinimumGapBufferSize);
 void InsertAtGap(GapBuffer& buf, const ImWchar* text, size_t size);
 void InsertAtGap(GapBuffer& buf, const char* text, size_t size);
 
@@ -94,6 +186,30 @@ void InsertAtGap(GapBuffer& buf, const char* text, size_t size);
 /// \return false if the offset goes past the buffer size.
 bool DeleteFromGap(GapBuffer& buf, int64_t offset);
 
+struct GapBufferEdit {
+    // Logical range to be replaced, [begin, end). For a pure insertion, begin == end.
+    int64_t begin;
+    int64_t end;
+    const ImWchar* text = nullptr;
+    size_t textSize = 0;
+};
+
+/// Apply many edits in a single pass over the buffer, instead of moving the gap around for each one of them.
+/// Edit ranges all refer to the text before any edit is applied, and must not overlap. `edits` gets sorted in place.
+/// The replacement texts must not point into `buf` itself. The gap is placed right after the last edit.
+/// \param positions Logical indices (e.g. cursors) to remap to the edited text, in place. A position at or after the
+///                  end of an edit moves along with the text after it; a position strictly inside a replaced range is
+///                  moved to the end of the replacement.
+void ApplyEdits(GapBuffer& buf, std::span<GapBufferEdit> edits, std::span<int64_t> positions = {});
+
+/// Take an immutable copy of the buffer's current content, without copying the text: the snapshot shares `buf`'s storage
+/// until `buf` needs to write somewhere the snapshot can see (e.g. the gap moves, or text gets deleted and then typed
+/// over), at which point `buf` copies the storage once and carries on with its own. Typing at the gap is free.
+/// The newline index is copied, which is O(number of paragraphs). Packed content is copied as-is.
+///
+/// Snapshots may be read, and released, on any thread while `buf` keeps being edited on its own thread.
+std::shared_ptr<const GapBuffer> TakeSnapshot(GapBuffer& buf);
+
 void DumpGapBuffer(const GapBuffer& buf, std::ostream& out);
 // Show the GapBuffer's content using ImGui
 void ShowGapBuffer(const GapBuffer& buf);
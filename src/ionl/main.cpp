@@ -1,10 +1,13 @@
 #include "ionl/markdown.hpp"
 #include <ionl/backing_store.hpp>
+#include <ionl/bulk_parse.hpp>
 #include <ionl/config.hpp>
 #include <ionl/document.hpp>
+#include <ionl/text_search.hpp>
 #include <ionl/utils.hpp>
 #include <ionl/widget_misc.hpp>
 #include <ionl/widget_text_edit.hpp>
+#include <ionl/worker_pool.hpp>
 
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_glfw.h>
@@ -24,9 +27,16 @@
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <variant>
+#include <vector>
 
 using namespace std::literals;
 using namespace Ionl;
@@ -36,25 +46,85 @@ static void GlfwErrorCallback(int error, const char* description) {
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
+struct ShownBullet {
+    Bullet* bullet;
+    int depth;
+};
+
 class DocumentView {
 private:
     Document* mDocument;
     Bullet* mCurrentBullet;
+    WorkerPool* mWorkerPool;
+    BulkMarkdownParser* mParser;
+    // Node based, the TextEdit's must stay in place
+    robin_hood::unordered_node_map<Pbid, TextEdit> mTextEdits;
+    // Where the TextEdit's at each depth began last frame, relative to the window's left edge. For predicting the width
+    // they will get before showing them.
+    std::vector<float> mTextEditOffsetsX;
+    // Scratch space, reused every frame
+    std::vector<ShownBullet> mShownBullets;
+    std::vector<Bullet*> mShownBulletPtrs;
+    std::vector<Pbid> mShownPbids;
+    std::vector<TextEditLayoutRequest> mLayoutRequests;
+    // Bullets whose TextEdit got dropped during the last Show(), because they were no longer shown
+    std::vector<Bullet*> mHiddenBullets;
+    // Bullet whose TextEdit was active during the last Show()
+    Bullet* mEditingBullet = nullptr;
+    std::string mSearchQuery;
+    bool mSearchCaseInsensitive = false;
+    // Bullets in here have `highlighted` set
+    std::vector<BulletSearchMatch> mSearchMatches;
 
 public:
-    DocumentView(Document& doc);
+    DocumentView(Document& doc, WorkerPool& workerPool, BulkMarkdownParser& parser);
 
     Document& GetDocument() { return *mDocument; }
     const Document& GetDocument() const { return *mDocument; }
     Bullet& GetCurrentBullet() { return *mCurrentBullet; }
     const Bullet& GetCurrentBullet() const { return *mCurrentBullet; }
+    Bullet* GetEditingBullet() const { return mEditingBullet; }
+    std::span<Bullet* const> GetHiddenBullets() const { return mHiddenBullets; }
+
+    /// The TextEdit for `bullet`'s text, which must already be loaded with Document::LoadBulletTexts().
+    TextEdit& GetBulletTextEdit(Bullet& bullet);
+    bool HasBulletTextEdit(const Bullet& bullet) const { return mTextEdits.contains(bullet.pbid); }
+    void SetTextEditOffsetX(int depth, float offsetX);
+    void SetEditingBullet(Bullet& bullet) { mEditingBullet = &bullet; }
 
     void Show();
+
+private:
+    void ShowSearchBar();
 };
 
-DocumentView::DocumentView(Document& doc)
+DocumentView::DocumentView(Document& doc, WorkerPool& workerPool, BulkMarkdownParser& parser)
     : mDocument{ &doc }
-    , mCurrentBullet{ &doc.GetRoot() } {
+    , mCurrentBullet{ &doc.GetRoot() }
+    , mWorkerPool{ &workerPool }
+    , mParser{ &parser } {
+}
+
+TextEdit& DocumentView::GetBulletTextEdit(Bullet& bullet) {
+    auto iter = mTextEdits.find(bullet.pbid);
+    if (iter != mTextEdits.end()) {
+        return iter->second;
+    }
+
+    auto& bc = std::get<BulletContentTextual>(bullet.content.v);
+    assert(bc.textBuffer);
+    // Same ID stack as ShowBulletContent()
+    ImGui::PushOverrideID(ImGui::GetCurrentWindow()->GetID(bullet.pbid));
+    ImGuiID id = ImGui::GetID("TextEdit");
+    ImGui::PopID();
+    return mTextEdits.try_emplace(bullet.pbid, id, *bc.textBuffer).first->second;
+}
+
+void DocumentView::SetTextEditOffsetX(int depth, float offsetX) {
+    if (depth >= (int)mTextEditOffsetsX.size()) {
+        mTextEditOffsetsX.resize(depth + 1, std::numeric_limits<float>::quiet_NaN());
+    }
+    mTextEditOffsetsX[depth] = offsetX;
 }
 
 // TODO move to config file
@@ -62,6 +132,7 @@ constexpr int kConfMaxFetchCount = 100;
 constexpr int kConfMaxFetchDepth = 6;
 
 struct ShowContext {
+    DocumentView* view;
     Document* document;
     Bullet* rootBullet;
     int depth = 0;
@@ -185,14 +256,40 @@ static void ShowBulletIcon(ShowContext& gctx, Bullet& bullet, ImGuiID id) {
 }
 
 static void ShowBulletContent(ShowContext& gctx, Bullet& bullet, ImGuiID id) {
-    // TODO replace with TextEdit
     ImGui::PushID(id);
     ::VisitVariantOverloaded(
         bullet.content.v,
         [&](BulletContentTextual& bc) {
-            // if (ImGui::InputText("##BulletContent", &bc.text)) {
-            //     bullet.document->UpdateBulletContent(bullet);
-            // }
+            auto window = ImGui::GetCurrentWindow();
+            gctx.view->SetTextEditOffsetX(gctx.depth, window->DC.CursorPos.x - window->Pos.x);
+
+            // Not loaded by LoadBulletTexts() since it would lose characters when unpacked, shown as-is instead
+            if (!bc.textBuffer) {
+                auto& utf8 = bc.text.packed->utf8;
+                ImGui::PushTextWrapPos(0.0f);
+                ImGui::TextUnformatted(utf8.data(), utf8.data() + utf8.size());
+                ImGui::PopTextWrapPos();
+                if (bullet.highlighted) {
+                    window->DrawList->AddRect(ImGui::GetItemRectMin(), ImGui::GetItemRectMax(), ImGui::GetColorU32(ImGuiCol_NavHighlight));
+                }
+                return;
+            }
+
+            auto& textEdit = gctx.view->GetBulletTextEdit(bullet);
+            int cacheDataVersion = bc.textBuffer->cacheDataVersion;
+            ImVec2 textEditPos = window->DC.CursorPos;
+            textEdit.Show();
+            if (bullet.highlighted) {
+                ImVec2 textEditSize(textEdit._cachedViewportWidth, textEdit._cachedContentHeight);
+                window->DrawList->AddRect(textEditPos, textEditPos + textEditSize, ImGui::GetColorU32(ImGuiCol_NavHighlight));
+            }
+            // TextEdit only refreshes the TextBuffer after editing it
+            if (bc.textBuffer->cacheDataVersion != cacheDataVersion) {
+                bullet.document->UpdateBulletContent(bullet);
+            }
+            if (ImGui::GetActiveID() == textEdit._id) {
+                gctx.view->SetEditingBullet(bullet);
+            }
         },
         [&](BulletContentMirror& bc) {
             // TODO
@@ -245,10 +342,86 @@ static void ShowBullet(ShowContext& gctx, Bullet& bullet, ImGuiID id) {
     }
 }
 
+// Same walk as ShowBullet(), within the same limits, without showing anything
+static void CollectShownBullets(ShowContext& gctx, Bullet& bullet, std::vector<ShownBullet>& out) {
+    if (gctx.count >= kConfMaxFetchCount) {
+        return;
+    }
+
+    if (gctx.rootBullet != &bullet) {
+        out.push_back({ .bullet = &bullet, .depth = gctx.depth });
+    }
+    gctx.count += 1;
+
+    if (!bullet.expanded || gctx.depth >= kConfMaxFetchDepth) {
+        return;
+    }
+    gctx.depth += 1;
+    for (Pbid childPbid : bullet.children) {
+        CollectShownBullets(gctx, gctx.document->FetchBulletByPbid(childPbid), out);
+    }
+    gctx.depth -= 1;
+}
+
 void DocumentView::Show() {
     ShowContext gctx;
+    gctx.view = this;
     gctx.document = mDocument;
     gctx.rootBullet = mCurrentBullet;
+    Bullet* lastEditingBullet = mEditingBullet;
+    mEditingBullet = nullptr;
+
+    ShowSearchBar();
+
+    // Load and lay out every bullet about to be shown all at once, rather than one by one as ShowBullet() gets to them.
+    // After a resize, every visible TextEdit needs a new layout in the same frame.
+    {
+        ShowContext collectCtx = gctx;
+        mShownBullets.clear();
+        CollectShownBullets(collectCtx, *mCurrentBullet, mShownBullets);
+
+        mShownBulletPtrs.clear();
+        mShownPbids.clear();
+        for (auto& sb : mShownBullets) {
+            mShownBulletPtrs.push_back(sb.bullet);
+            mShownPbids.push_back(sb.bullet->pbid);
+        }
+        mDocument->LoadBulletTexts(mShownBulletPtrs, *mParser, gConfig.undoJournalByteLimit);
+
+        // Bullets that went out of view (collapsed, scrolled past the fetch limits) don't need their TextEdit anymore.
+        // Their text gets packed again by ShowAppViews(), unless another view still shows them.
+        std::sort(mShownPbids.begin(), mShownPbids.end());
+        mHiddenBullets.clear();
+        for (auto iter = mTextEdits.begin(); iter != mTextEdits.end();) {
+            Pbid pbid = iter->first;
+            bool isShown = std::binary_search(mShownPbids.begin(), mShownPbids.end(), pbid);
+            if (isShown || (lastEditingBullet && lastEditingBullet->pbid == pbid)) {
+                ++iter;
+                continue;
+            }
+            if (auto bullet = mDocument->GetBulletByPbid(pbid)) {
+                mHiddenBullets.push_back(bullet);
+            }
+            iter = mTextEdits.erase(iter);
+        }
+
+        mLayoutRequests.clear();
+        for (auto& sb : mShownBullets) {
+            // A depth that hasn't been shown yet, TextEdit::Show() will lay it out itself
+            if (sb.depth >= (int)mTextEditOffsetsX.size() || std::isnan(mTextEditOffsetsX[sb.depth])) {
+                continue;
+            }
+            auto bc = std::get_if<BulletContentTextual>(&sb.bullet->content.v);
+            if (!bc || !bc->textBuffer) {
+                continue;
+            }
+            mLayoutRequests.push_back({
+                .textEdit = &GetBulletTextEdit(*sb.bullet),
+                .viewportWidth = ImGui::GetContentRegionAvailWidthAt(mTextEditOffsetsX[sb.depth]),
+            });
+        }
+        LayTextEditsInParallel(*mWorkerPool, mLayoutRequests);
+    }
 
     // TODO better ID
     ShowBullet(gctx, *mCurrentBullet, ImGui::GetID("Ionl Document"));
@@ -261,6 +434,35 @@ void DocumentView::Show() {
     }
 }
 
+void DocumentView::ShowSearchBar() {
+    bool changed = false;
+    ImGui::SetNextItemWidth(ImGui::GetFontSize() * 16);
+    changed |= ImGui::InputTextWithHint("##Search", "Search loaded bullets", &mSearchQuery);
+    ImGui::SameLine();
+    changed |= ImGui::Checkbox("Aa", &mSearchCaseInsensitive);
+    if (!mSearchQuery.empty()) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("%zu matches", mSearchMatches.size());
+    }
+    if (!changed) {
+        return;
+    }
+
+    // NOTE: only searched when the query changes, bullets fetched or edited afterwards keep their old highlight state
+    for (auto& match : mSearchMatches) {
+        if (auto bullet = mDocument->GetBulletByPbid(match.bullet)) {
+            bullet->highlighted = false;
+        }
+    }
+    mSearchMatches.clear();
+    mDocument->SearchLoadedBullets(SearchPattern(mSearchQuery, mSearchCaseInsensitive), mSearchMatches);
+    for (auto& match : mSearchMatches) {
+        if (auto bullet = mDocument->GetBulletByPbid(match.bullet)) {
+            bullet->highlighted = true;
+        }
+    }
+}
+
 struct AppView {
     DocumentView view;
     bool windowOpen = true;
@@ -270,15 +472,24 @@ struct AppState {
     Ionl::SQLiteBackingStore storeActual;
     Ionl::WriteDelayedBackingStore storeFacade;
     Ionl::Document document;
+    // For work spread over bullets, e.g. laying out every visible one after a resize
+    Ionl::WorkerPool workerPool;
+    // Parses bullets as they get loaded, e.g. when a subtree is expanded
+    Ionl::BulkMarkdownParser bulkParser;
     std::vector<AppView> views;
+    // Bullet focused in any of the views, as of the last frame
+    Ionl::Bullet* editingBullet = nullptr;
+    Ionl::GapCompactionStats lastCompactionStats;
+    int64_t totalBytesTrimmed = 0;
 
     AppState()
         : storeActual("./notebook.sqlite3")
         , storeFacade(storeActual)
-        , document(storeActual) //
+        , document(storeFacade)
+        , bulkParser(workerPool) //
     {
         views.push_back(AppView{
-            .view = DocumentView(document),
+            .view = DocumentView(document, workerPool, bulkParser),
             .windowOpen = true,
         });
     }
@@ -295,6 +506,7 @@ static const std::string& ResolveContentToText(Ionl::Document& document, const I
 }
 
 static void ShowAppViews(AppState& as) {
+    as.editingBullet = nullptr;
     for (size_t i = 0; i < as.views.size(); ++i) {
         auto& dv = as.views[i];
         auto& currBullet = dv.view.GetCurrentBullet();
@@ -317,6 +529,22 @@ static void ShowAppViews(AppState& as) {
         ImGui::Begin(windowName, &dv.windowOpen);
         dv.view.Show();
         ImGui::End();
+
+        if (auto bullet = dv.view.GetEditingBullet()) {
+            as.editingBullet = bullet;
+        }
+    }
+
+    // Bullets that went out of view go back to being packed, to save the memory of the wide character buffer
+    for (auto& dv : as.views) {
+        for (Bullet* bullet : dv.view.GetHiddenBullets()) {
+            bool isShownElsewhere = std::any_of(as.views.begin(), as.views.end(), [&](const AppView& that) {
+                return that.view.HasBulletTextEdit(*bullet);
+            });
+            if (!isShownElsewhere && bullet != as.editingBullet) {
+                as.document.UnloadBulletText(*bullet);
+            }
+        }
     }
 
 #if IONL_DEBUG_FEATURES
@@ -342,15 +570,45 @@ int main() {
 ```
 )"""sv.substr(1); // Remove initial \n
 
-        static auto textBuffer = TextBuffer(GapBuffer(kExampleText));
+        static auto textBuffer = TextBuffer(GapBuffer(kExampleText), gConfig.undoJournalByteLimit);
         static auto textEdit = TextEdit(ImGui::GetID("TextEdit"), textBuffer);
 
         textEdit.Show();
     }
     ImGui::End();
+
+    ImGui::Begin("dbg: Gap compaction");
+    ImGui::Text("Last gap compaction: %lld/%lld buffers shrunk, %lld bytes trimmed",
+        (long long)as.lastCompactionStats.buffersShrunk,
+        (long long)as.lastCompactionStats.buffersVisited,
+        (long long)as.lastCompactionStats.bytesTrimmed);
+    // Given back to malloc, not necessarily to the OS
+    ImGui::Text("Total trimmed by gap compaction: %lld bytes", (long long)as.totalBytesTrimmed);
+    ImGui::End();
 #endif
 }
 
+// Request frames for what ImGui does over time without new input: auto-repeat of held keys, and hover delays
+static void RequestFramesForImGui(const ImGuiContext& ctx) {
+    if (ImGui::IsAnyMouseDown()) {
+        RequestFrameWithin(0.0f);
+        return;
+    }
+    for (int key = ImGuiKey_NamedKey_BEGIN; key < ImGuiKey_GamepadStart; ++key) {
+        // Modifiers don't repeat
+        if (key >= ImGuiKey_LeftCtrl && key <= ImGuiKey_RightSuper) {
+            continue;
+        }
+        if (ImGui::IsKeyDown((ImGuiKey)key)) {
+            RequestFrameWithin(0.0f);
+            return;
+        }
+    }
+    if (ctx.HoveredId != 0 && ctx.HoveredIdTimer < ctx.Style.HoverDelayNormal) {
+        RequestFrameWithin(ctx.Style.HoverDelayNormal - ctx.HoveredIdTimer);
+    }
+}
+
 int main() {
     LoadConfigFromFile(gConfig, fs::path("./config.toml"));
 
@@ -429,10 +687,33 @@ int main() {
     }
 
     AppState as;
-    double lastWriteTime = 0.0;
-    double lastIdleTime = 0.0;
+    MainLoopTimes times{
+        .currTime = 0.0,
+        .lastEditTime = 0.0,
+        .lastWriteTime = 0.0,
+        .lastCompactionTime = 0.0,
+        .hasUnflushedOps = false,
+    };
+    // ImGui reacts to some input over a few frames (e.g. hover highlights, windows appearing), draw these many before
+    // sleeping again
+    constexpr int kFramesAfterInput = 3;
+    int framesAfterInput = kFramesAfterInput;
+    double frameTimeout = 0.0;
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+        // Sleep until there is input, or something scheduled is due
+        if (framesAfterInput > 0) {
+            framesAfterInput -= 1;
+            glfwPollEvents();
+        } else if (frameTimeout <= 0.0) {
+            glfwPollEvents();
+        } else if (std::isinf(frameTimeout)) {
+            glfwWaitEvents();
+        } else {
+            glfwWaitEventsTimeout(frameTimeout);
+        }
+        if (!ctx.InputEventsQueue.empty()) {
+            framesAfterInput = kFramesAfterInput;
+        }
 
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
@@ -457,19 +738,29 @@ int main() {
 
         glfwSwapBuffers(window);
 
+        times.currTime = currTime;
         if (ufopsCntBeforeFrame != ufopsCntAfterFrame) {
-            lastIdleTime = currTime;
+            times.lastEditTime = currTime;
         }
+        times.hasUnflushedOps = ufopsCntAfterFrame > 0;
 
-        if (ufopsCntAfterFrame > 0) {
-            // Save strategy:
-            if ((currTime - lastIdleTime) > /*seconds*/ 1.0 || // ... after 1 second of idle
-                (currTime - lastWriteTime) > /*seconds*/ 10.0) // ... or every 10 seconds
-            {
-                lastWriteTime = currTime;
-                as.storeFacade.FlushOps();
-            }
+        // Save strategy
+        if (currTime >= CalcNextSaveTime(times)) {
+            times.lastWriteTime = currTime;
+            as.storeFacade.FlushOps();
+            times.hasUnflushedOps = false;
+        }
+
+        // Compaction strategy
+        if (currTime >= CalcNextCompactionTime(times)) {
+            times.lastCompactionTime = currTime;
+            as.lastCompactionStats = as.document.CompactBulletGaps(as.editingBullet);
+            as.totalBytesTrimmed += as.lastCompactionStats.bytesTrimmed;
         }
+
+        RequestFramesForImGui(ctx);
+        // Also wake up for the save and compaction strategies above
+        frameTimeout = CalcFrameTimeout(TakeRequestedFrameTimeout(), times);
     }
 
     if (as.storeFacade.GetUnflushedOpsCount() > 0) {
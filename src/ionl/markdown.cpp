@@ -5,9 +5,17 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <limits>
 #include <utility>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    define IONL_MARKDOWN_SSE2 1
+#    include <emmintrin.h>
+#else
+#    define IONL_MARKDOWN_SSE2 0
+#endif
+
 using namespace std::literals;
 
 static size_t AmalgamateVariantFlags(bool isMonospace, bool isBold, bool isItalic) {
@@ -89,60 +97,100 @@ static void ToggleStyleForControlSeq(Ionl::TextStyle& style, TokenType ctrlseq)
     }
 }
 
-// Ionl::ParseMarkdownBuffer example #1
-// Input text:
-//     Test **bold _and italic __text__ with_ strangling_underscores** **_nest_** finishing words
-// Expected output TextRun's:
-//     ----- "Test "
-//     b---- "**bold "
-//     bi--- "_and italic "
-//     biu-- "__text__"
-//     bi--- " with_"
-//     b---- " strangling_underscores**"
-//     ----- " "
-//     b---- "**"
-//     bi--- "_nest_"
-//     b---- "**"
-//     ----- " finishing words"
+namespace {
+// Characters that may begin a control sequence or escape one, anywhere in a paragraph. '#' only matters at the beginning
+// of a line, and '\n' never appears inside a paragraph; the parser handles both separately.
+bool IsSpecialChar(ImWchar c) {
+    return c == '`' || c == '*' || c == '_' || c == '~' || c == '\\';
+}
 
-auto Ionl::ParseMarkdownBuffer(const GapBuffer& src) -> std::vector<TextRun> {
-    std::vector<TextRun> result;
+const ImWchar* FindSpecialCharInSegment(const ImWchar* p, const ImWchar* end) {
+#if IONL_MARKDOWN_SSE2
+    constexpr int kLanes = 16 / sizeof(ImWchar);
+
+    const __m128i backtick = _mm_set1_epi16('`');
+    const __m128i asterisk = _mm_set1_epi16('*');
+    const __m128i underscore = _mm_set1_epi16('_');
+    const __m128i tilde = _mm_set1_epi16('~');
+    const __m128i backslash = _mm_set1_epi16('\\');
+    while (end - p >= kLanes) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi16(v, backtick), _mm_cmpeq_epi16(v, asterisk)),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(v, underscore), _mm_cmpeq_epi16(v, tilde)), _mm_cmpeq_epi16(v, backslash)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) {
+            // Each lane produces 2 bits in the mask
+            return p + std::countr_zero((unsigned)mask) / sizeof(ImWchar);
+        }
+        p += kLanes;
+    }
+#endif
 
-    // TODO handle cases like ***bold and italic***, the current greedy matching method parses it as **/*text**/* which breaks the control seq pairing logic
-    //      probably has to handle this by parsing *** specially, and then do some fancy pairing logic with ***/**/* tokens to break this one up
+    for (; p != end; ++p) {
+        if (IsSpecialChar(*p)) {
+            return p;
+        }
+    }
+    return end;
+}
 
-    // TODO might be an idea to adopt GFM, i.e. do paragraph break only on 2 or more consecutive \n, a single \n is simply ignored for formatting
-    //      but this might not be that useful since we are not performing rendering on this
+// \return Logical index of the first special character in [begin, end), or `end` if there is none.
+int64_t FindNextSpecialChar(const Ionl::GapBuffer& src, int64_t begin, int64_t end) {
+    const ImWchar* buffer = src.buffer;
+    int64_t frontSize = src.frontSize;
+
+    // Part in front
+    if (begin < frontSize) {
+        int64_t segmentEnd = std::min(end, frontSize);
+        auto hit = FindSpecialCharInSegment(buffer + begin, buffer + segmentEnd);
+        if (hit != buffer + segmentEnd) {
+            return hit - buffer;
+        }
+        begin = segmentEnd;
+    }
+
+    // Part in back
+    if (begin < end) {
+        const ImWchar* back = buffer + src.gapSize;
+        auto hit = FindSpecialCharInSegment(back + begin, back + end);
+        return hit - back;
+    }
+    return end;
+}
+
+} // namespace
+
+struct Ionl::MarkdownToken {
+    int64_t begin; // Logical index
+    int64_t end; // Logical index
+    size_t pairedTokenIdx = std::numeric_limits<size_t>::max();
+    int headingLevel = 0;
+    TokenType type;
+
+    bool IsControlSequence() const {
+        auto n = (int)type;
+        return n >= (int)TokenType::CtlSeq_BEGIN && n < (int)TokenType::CtlSeq_END;
+    }
+
+    bool HasPairedToken() const { return pairedTokenIdx != std::numeric_limits<size_t>::max(); }
+};
+
+namespace {
+// Parse the paragraph at logical range [begin, end), which doesn't include the '\n' ending it.
+// Since inline formatting never extends past a paragraph, paragraphs are parsed fully independently of each other. This
+// is what makes it possible to reparse only the edited paragraphs, and get the same result as parsing everything.
+void ParseParagraph(const Ionl::GapBuffer& src, int64_t begin, int64_t end, bool hasParagraphBreak, std::vector<Ionl::MarkdownToken>& tokens, std::vector<Ionl::TextRun>& out) {
+    using namespace Ionl;
 
     constexpr auto kInvalidTokenIdx = std::numeric_limits<size_t>::max();
-    constexpr auto kMaxHeadingLevel = 5;
-
-    struct Token {
-        int64_t begin;
-        int64_t end;
-        // For some reason MSVC rejects this (referring to a local variable?)
-        //        size_t pairedTokenIdx = kInvalidTokenIdx;
-        size_t pairedTokenIdx = std::numeric_limits<size_t>::max();
-        int headingLevel = 0;
-        TokenType type;
-        bool dead = false; //< Flag used to mark weather this control sequence token is allowed to have a match
-
-        bool IsText() const {
-            return type == TokenType::Text;
-        }
 
-        bool IsControlSequence() const {
-            auto n = (int)type;
-            return n >= (int)TokenType::CtlSeq_BEGIN && n < (int)TokenType::CtlSeq_END;
-        }
+    tokens.clear();
 
-        bool HasPairedToken() const { return pairedTokenIdx != kInvalidTokenIdx; }
+    // Characters past the end of the paragraph read as '\0', so that lookahead never matches across it
+    auto at = [&](int64_t idx) -> ImWchar {
+        return idx < end ? src[idx] : '\0';
     };
-    std::vector<Token> tokens;
-
-    // The characters inside the parser's processing area (for size N, basically 1 current char + N-1 lookahead chars)
-    constexpr int64_t kVisionSize = 3;
-    ImWchar visionBuffer[kVisionSize] = {};
 
     bool isEscaping = false;
     bool isBeginningOfLine = true;
@@ -150,247 +198,154 @@ auto Ionl::ParseMarkdownBuffer(const GapBuffer& src) -> std::vector<TextRun> {
     // > 0, heading
     int currHeadingLevel = 0;
 
-    int64_t reader;
-    int readerAdvance = kVisionSize;
-    int readerAdvanceDone = 0; // Used inside loop, keeping track of number of advancements completed across segment changes
+    int64_t readerAdvance;
+    for (int64_t reader = begin; reader < end; reader += readerAdvance) {
+        ImWchar c = at(reader);
 
-    auto produceControlSequence = [&](TokenType tokenType) {
-        if (isEscaping) {
+        // Plain text can't change any of the parser's state other than ending escaping and the beginning of line, so
+        // skip right to the next character that might be interesting. Most text is plain, this is where the time goes.
+        if (!IsSpecialChar(c) && !(isBeginningOfLine && c == '#')) {
             isEscaping = false;
-            return;
+            isBeginningOfLine = false;
+            readerAdvance = FindNextSpecialChar(src, reader + 1, end) - reader;
+            continue;
         }
 
-        auto tokenBeginIdx = AdjustBufferIndex(src, reader, -kVisionSize);
-        tokens.push_back(Token{
-            .begin = tokenBeginIdx,
-            .end = tokenBeginIdx + readerAdvance,
-            .headingLevel = currHeadingLevel,
-            .type = tokenType,
-        });
-    };
+        // Move ahead by 1 character by default, overridden by parser branches below
+        readerAdvance = 1;
 
-    std::pair<int64_t, int64_t> sourceSegments[] = {
-        { src.GetFrontBegin(), src.GetFrontSize() },
-        { src.GetBackBegin(), src.GetBackSize() },
-        // The dummy segment at the very end for `reader` to advance until the very end of source buffer
-        { src.GetBackEnd(), kVisionSize - 1 },
-    };
-    for (auto it = std::begin(sourceSegments); it != std::end(sourceSegments); ++it) {
-        const auto& sourceSegment = *it;
-        bool isLastSourceSegment = it + 1 == std::end(sourceSegments);
-
-        // The main parser body.
-        // The parser works by running the parser branches repeatedly for this segment, trying to match stuff within the vision buffer.
-        // It may instruct `reader` to be advanced by a certain number, depending on what it saw.
-
-        // `reader` is index to the next char to be read into the vision buffer.
-        //  Use AdjustBufferIndex(buffer, reader, -kVisionSize) to get idx of the first char in the vision buffer.
-
-        // `readerAdvance` is the number of characters the parser will advance, handled at the top.
-        // `readerAdvance` and `readerAdvanceDone` are kept across segment changes to achieve the following logic:
-        // - The parser body is executed, setting a `readerAdvance` value
-        // - Next iteration, we start advancing `reader`; if we hit end of a segment boundary, we skip onto the next
-        //   segment by running `goto segmentDone;`
-        //   and then continuing to advance `reader` until we finished the request value
-
-        int64_t segmentBegin = sourceSegment.first;
-        int64_t segmentEnd = sourceSegment.first + sourceSegment.second;
-
-        reader = segmentBegin;
-        while (true) {
-            // Advance `reader`
-            for (; readerAdvanceDone < readerAdvance; ++readerAdvanceDone) {
-                if (reader >= segmentEnd) {
-                    goto segmentDone;
-                }
-
-                std::shift_left(std::begin(visionBuffer), std::end(visionBuffer), 1);
-                if (!isLastSourceSegment) {
-                    visionBuffer[kVisionSize - 1] = src.buffer[reader];
-                } else {
-                    visionBuffer[kVisionSize - 1] = '\0';
-                }
-                reader += 1;
+        auto produceControlSequence = [&](TokenType tokenType) {
+            if (isEscaping) {
+                isEscaping = false;
+                return;
             }
-            readerAdvanceDone = 0;
 
-            // Move ahead by 1 character by default, overridden by parser branches below
-            readerAdvance = 1;
-
-            // Parse heading
-            if (isBeginningOfLine && visionBuffer[0] == '#') {
-                auto beginIdx = AdjustBufferIndex(src, reader, -kVisionSize);
-
-                // We need quite a lot of lookahead here, so we use GapBufferIterator instead of having a super large vision buffer to avoid having to move around lots of data in the normal code path
-                GapBuffer::const_iterator iter(src, beginIdx);
-                int headingLevel = 1;
-                while (*iter == '#' && iter.HasNext()) {
-                    headingLevel += 1;
-                    ++iter;
-                }
-
-                if (*iter == ' ') {
-                    // Parsed heading sequence successfully
-                    currHeadingLevel = headingLevel;
-                    readerAdvance = headingLevel;
-
-                    continue;
-                } else {
-                    // Bad heading sequence, skip all the scanned parts as plain text
-                    readerAdvance = headingLevel + 1;
-                }
+            tokens.push_back(MarkdownToken{
+                .begin = reader,
+                .end = reader + readerAdvance,
+                .headingLevel = currHeadingLevel,
+                .type = tokenType,
+            });
+        };
+
+        // Parse heading
+        if (isBeginningOfLine && c == '#') {
+            int headingLevel = 1;
+            int64_t iter = reader;
+            while (at(iter) == '#') {
+                headingLevel += 1;
+                ++iter;
             }
 
-            if (visionBuffer[0] == '`') {
-                if (visionBuffer[1] == '`' && visionBuffer[2] == '`') {
-                    // ```code block```
-                    readerAdvance = 3;
-                    produceControlSequence(TokenType::CtlSeqCodeBlock);
-                    // TODO eat until next ``` closer
-                    continue;
-                }
-                // `inline code`
-                readerAdvance = 1;
-                produceControlSequence(TokenType::CtlSeqInlineCode);
-                continue;
-            }
-            if (visionBuffer[0] == '*') {
-                if (visionBuffer[1] == '*') {
-                    // **bold**
-                    readerAdvance = 2;
-                    produceControlSequence(TokenType::CtlSeqBold);
-                } else {
-                    // *bold*
-                    readerAdvance = 1;
-                    produceControlSequence(TokenType::CtlSeqItalicAsterisk);
-                }
+            if (at(iter) == ' ') {
+                // Parsed heading sequence successfully
+                currHeadingLevel = headingLevel;
+                readerAdvance = headingLevel;
+
                 continue;
+            } else {
+                // Bad heading sequence, skip all the scanned parts as plain text
+                readerAdvance = headingLevel + 1;
             }
-            if (visionBuffer[0] == '_') {
-                if (visionBuffer[1] == '_') {
-                    // __underline__
-                    readerAdvance = 2;
-                    produceControlSequence(TokenType::CtlSeqUnderline);
-                } else {
-                    // _italics_
-                    readerAdvance = 1;
-                    produceControlSequence(TokenType::CtlSeqItalicUnderscore);
-                }
+        }
+
+        if (c == '`') {
+            if (at(reader + 1) == '`' && at(reader + 2) == '`') {
+                // ```code block```
+                readerAdvance = 3;
+                produceControlSequence(TokenType::CtlSeqCodeBlock);
+                // TODO eat until next ``` closer
                 continue;
             }
-            if (visionBuffer[0] == '~' && visionBuffer[1] == '~') {
-                // ~~strikethrough~~
+            // `inline code`
+            readerAdvance = 1;
+            produceControlSequence(TokenType::CtlSeqInlineCode);
+            continue;
+        }
+        if (c == '*') {
+            if (at(reader + 1) == '*') {
+                // **bold**
                 readerAdvance = 2;
-                produceControlSequence(TokenType::CtlSeqStrikethrough);
-                continue;
+                produceControlSequence(TokenType::CtlSeqBold);
+            } else {
+                // *bold*
+                readerAdvance = 1;
+                produceControlSequence(TokenType::CtlSeqItalicAsterisk);
             }
-
-            // Set escaping state for the next character
-            // If this is a '\', and it's being escaped, treat this just as plain text; otherwise escape the next character
-            // If this is anything else, this condition will evaluate to false
-            isEscaping = visionBuffer[0] == '\\' && !isEscaping;
-
-            // Set for next iteration
-            if (visionBuffer[0] == '\n') {
-                auto beginIdx = AdjustBufferIndex(src, reader, -kVisionSize);
-                tokens.push_back({
-                    .begin = beginIdx,
-                    .end = beginIdx + 1,
-                    .headingLevel = currHeadingLevel,
-                    .type = TokenType::ParagraphBreak,
-                });
-
-                isBeginningOfLine = true;
-                isEscaping = false;
-                currHeadingLevel = 0;
+            continue;
+        }
+        if (c == '_') {
+            if (at(reader + 1) == '_') {
+                // __underline__
+                readerAdvance = 2;
+                produceControlSequence(TokenType::CtlSeqUnderline);
             } else {
-                isBeginningOfLine = false;
+                // _italics_
+                readerAdvance = 1;
+                produceControlSequence(TokenType::CtlSeqItalicUnderscore);
             }
+            continue;
         }
+        if (c == '~' && at(reader + 1) == '~') {
+            // ~~strikethrough~~
+            readerAdvance = 2;
+            produceControlSequence(TokenType::CtlSeqStrikethrough);
+            continue;
+        }
+
+        // Set escaping state for the next character
+        // If this is a '\', and it's being escaped, treat this just as plain text; otherwise escape the next character
+        // If this is anything else, this condition will evaluate to false
+        isEscaping = c == '\\' && !isEscaping;
 
-    segmentDone:;
+        isBeginningOfLine = false;
     }
 
     // Do token pairing
-    std::vector<size_t> tokenPairingStack;
+    // A control sequence always pairs with the latest open one of its type, so there is never more than one open control
+    // sequence of each type. Keeping one opener slot per type makes pairing O(1) per token, no matter the input.
+    constexpr int kNumCtlSeqTypes = (int)TokenType::CtlSeq_END - (int)TokenType::CtlSeq_BEGIN;
+    size_t openers[kNumCtlSeqTypes];
+    std::fill(std::begin(openers), std::end(openers), kInvalidTokenIdx);
     for (size_t currIdx = 0; currIdx < tokens.size(); ++currIdx) {
         auto& curr = tokens[currIdx];
-        if (curr.IsControlSequence()) {
-            // Scan the stack for matching controls
-            // This is just a backwards iteration loop -- not using reverse iterator because converting them to indices for std::vector::resize is even more confusing than this
-            for (size_t candIdxIt = tokenPairingStack.size(); candIdxIt-- > 0;) {
-                size_t candIdx = tokenPairingStack[candIdxIt];
-                auto& cand = tokens[candIdx];
-
-                assert(candIdx != currIdx);
-
-                // Case: found
-                // - Discard all controls after this one, they are unmatched, e.g. **text__** gives a bold 'text__'
-                // - This leaves the pairedSymbolIndex field as undefined, which implies that it's not consumed
-                if (cand.type == curr.type) {
-                    cand.pairedTokenIdx = currIdx;
-                    curr.pairedTokenIdx = candIdx;
-
-                    if (cand.type == TokenType::CtlSeqInlineCode) {
-                        // Disable all other formatting control sequences inside inline code
-                        for (size_t i = candIdx + 1; i < currIdx; ++i) {
-                            auto& token = tokens[i];
-                            token.pairedTokenIdx = kInvalidTokenIdx;
-                        }
-                    }
-
-                    // Remove elements in vector including and after the `candIdxIdx`-th element
-                    tokenPairingStack.resize(candIdxIt);
-                    goto searchPairsDone;
-                }
-            }
-
-            // Case: not found
-            // - Push symbol into stack
-            tokenPairingStack.push_back(currIdx);
-
-        searchPairsDone:;
+        if (!curr.IsControlSequence()) {
+            continue;
         }
-    }
-    // At this point everything left in `tokenPairingStack` is also unpaired
-
-    // TODO if we inserted a ParagraphBreak at the very end, it could make TextRun generation much simpler
-
-    // Insert a single TextRun into `result`, while handling breaking across the gap
-    auto outputTextRun = [&result, &src](TextRun run) {
-        auto gapBegin = src.GetGapBegin();
-        auto gapEnd = src.GetGapEnd();
-
-        assert(run.begin < run.end);
-        assert(run.end - run.begin > 0);
-        // It CANNOT be the case that both begin and end are on the gap boundary, because that is a 0-length TextRun
-        assert(!(run.begin == gapBegin && run.end == gapEnd));
 
-        if (run.begin < gapBegin && run.end > gapEnd) {
-            // TextRun spans over the gap, we need to split it
-            TextRun& frontRun = run;
-            TextRun backRun = run;
+        auto& opener = openers[(int)curr.type - (int)TokenType::CtlSeq_BEGIN];
+        if (opener == kInvalidTokenIdx) {
+            opener = currIdx;
+            continue;
+        }
 
-            /* frontRun.begin; */ // Remain unchanged
-            frontRun.end = gapBegin;
-            backRun.begin = gapEnd;
-            /* backRun.end; */ // Remain unchanged
+        size_t candIdx = opener;
+        auto& cand = tokens[candIdx];
+        cand.pairedTokenIdx = currIdx;
+        curr.pairedTokenIdx = candIdx;
+
+        if (cand.type == TokenType::CtlSeqInlineCode) {
+            // Disable all other formatting control sequences inside inline code
+            // NOTE: this is still linear overall, as inline code spans can't overlap or nest
+            for (size_t i = candIdx + 1; i < currIdx; ++i) {
+                auto& token = tokens[i];
+                token.pairedTokenIdx = kInvalidTokenIdx;
+            }
+        }
 
-            result.push_back(std::move(frontRun));
-            result.push_back(std::move(backRun));
-        } else {
-            // If either begin or end is on the gap boundary, move it to the other side.
-            // This way we have a contiguous segment of text again.
-            if (run.begin == gapBegin)
-                run.begin = gapEnd;
-            if (run.end == gapEnd)
-                run.end = gapBegin;
-            result.push_back(std::move(run));
+        // Discard all controls opened after this one, they are unmatched, e.g. **text__** gives a bold 'text__'
+        // This leaves their pairedTokenIdx field as invalid, which implies that they are not consumed
+        for (auto& o : openers) {
+            if (o != kInvalidTokenIdx && o >= candIdx) {
+                o = kInvalidTokenIdx;
+            }
         }
-    };
+    }
+    // At this point everything left in `openers` is also unpaired
 
     TextStyle currStyle{};
-    int64_t currTextRunBegin = 0;
+    int64_t currTextRunBegin = begin;
+    size_t paragraphFirstRun = out.size();
 
     auto outputCurrTextRun = [&](int headingLevel, int64_t end) {
         if (currTextRunBegin == end) {
@@ -398,9 +353,9 @@ auto Ionl::ParseMarkdownBuffer(const GapBuffer& src) -> std::vector<TextRun> {
         }
 
         currStyle.type = MakeHeadingLevel(headingLevel);
-        outputTextRun({
-            .begin = currTextRunBegin,
-            .end = end,
+        out.push_back(TextRun{
+            .begin = (int32_t)currTextRunBegin,
+            .end = (int32_t)end,
             .style = currStyle,
         });
     };
@@ -408,18 +363,6 @@ auto Ionl::ParseMarkdownBuffer(const GapBuffer& src) -> std::vector<TextRun> {
     for (size_t idx = 0; idx < tokens.size(); ++idx) {
         const auto& token = tokens[idx];
 
-        if (token.type == TokenType::ParagraphBreak) {
-            outputCurrTextRun(token.headingLevel, token.begin);
-            if (!result.empty()) {
-                result.back().hasParagraphBreak = true;
-            }
-
-            currTextRunBegin = token.end; // We don't want the \n char to be a part of the text output
-            currStyle = {};
-
-            continue;
-        }
-
         if (token.IsControlSequence() && token.HasPairedToken()) {
             int64_t boundary = token.pairedTokenIdx > idx
                 // This is an opening control sequence
@@ -433,15 +376,192 @@ auto Ionl::ParseMarkdownBuffer(const GapBuffer& src) -> std::vector<TextRun> {
         }
     }
     // Add the last text range if there is any left
-    if (auto lastTextEnd = src.GetLastTextEnd();
-        currTextRunBegin != lastTextEnd)
-    {
-        outputTextRun({
-            .begin = currTextRunBegin,
-            .end = lastTextEnd,
-            .style = currStyle,
-        });
+    outputCurrTextRun(currHeadingLevel, end);
+
+    // An empty paragraph has no TextRun to put the break on, but then the paragraph before it has already broken there
+    if (hasParagraphBreak && out.size() > paragraphFirstRun) {
+        out.back().hasParagraphBreak = true;
     }
+}
+} // namespace
+
+// Ionl::ParseMarkdownBuffer example #1
+// Input text:
+//     Test **bold _and italic __text__ with_ strangling_underscores** **_nest_** finishing words
+// Expected output TextRun's:
+//     ----- "Test "
+//     b---- "**bold "
+//     bi--- "_and italic "
+//     biu-- "__text__"
+//     bi--- " with_"
+//     b---- " strangling_underscores**"
+//     ----- " "
+//     b---- "**"
+//     bi--- "_nest_"
+//     b---- "**"
+//     ----- " finishing words"
+
+Ionl::MarkdownParser::MarkdownParser() = default;
+Ionl::MarkdownParser::MarkdownParser(MarkdownParser&&) noexcept = default;
+Ionl::MarkdownParser& Ionl::MarkdownParser::operator=(MarkdownParser&&) noexcept = default;
+Ionl::MarkdownParser::~MarkdownParser() = default;
+
+void Ionl::MarkdownParser::ParseParagraphs(const GapBuffer& src, int64_t begin, int64_t end, std::vector<TextRun>& out) {
+    // TODO handle cases like ***bold and italic***, the current greedy matching method parses it as **/*text**/* which breaks the control seq pairing logic
+    //      probably has to handle this by parsing *** specially, and then do some fancy pairing logic with ***/**/* tokens to break this one up
 
+    // TODO might be an idea to adopt GFM, i.e. do paragraph break only on 2 or more consecutive \n, a single \n is simply ignored for formatting
+    //      but this might not be that useful since we are not performing rendering on this
+
+    int64_t contentSize = src.GetContentSize();
+    int64_t paragraph = FindParagraphContaining(src, begin);
+    while (true) {
+        int64_t paragraphBegin = GetParagraphBegin(src, paragraph);
+        int64_t paragraphEnd = GetParagraphEnd(src, paragraph);
+        ParseParagraph(src, paragraphBegin, paragraphEnd, /*hasParagraphBreak*/ paragraphEnd < contentSize, tokens, out);
+
+        if (paragraphEnd >= end) {
+            break;
+        }
+        paragraph += 1;
+    }
+}
+
+auto Ionl::ParseMarkdownBuffer(const GapBuffer& src) -> std::vector<TextRun> {
+    std::vector<TextRun> result;
+    ParseMarkdownBuffer(src, result);
     return result;
 }
+
+void Ionl::ParseMarkdownBuffer(const GapBuffer& src, std::vector<TextRun>& out) {
+    thread_local MarkdownParser parser;
+    thread_local std::vector<TextRun> logicalRuns;
+
+    logicalRuns.clear();
+    parser.ParseParagraphs(src, 0, src.GetContentSize(), logicalRuns);
+    MapTextRunsToBuffer(src, logicalRuns, out);
+}
+
+void Ionl::MapTextRunsToBuffer(const GapBuffer& src, const std::vector<TextRun>& logicalRuns, std::vector<TextRun>& out) {
+    // NOTE: not reserving the exact size here, that would reallocate every time a TextRun gets added
+    out.clear();
+
+    int64_t gapBegin = src.GetGapBegin();
+    int64_t gapSize = src.GetGapSize();
+    for (TextRun run : logicalRuns) {
+        if (run.begin < gapBegin && run.end > gapBegin) {
+            // TextRun spans over the gap, we need to split it
+            TextRun& frontRun = run;
+            TextRun backRun = run;
+
+            /* frontRun.begin; */ // Remain unchanged
+            frontRun.end = (int32_t)gapBegin;
+            frontRun.hasParagraphBreak = false;
+            backRun.begin = (int32_t)(gapBegin + gapSize);
+            backRun.end += (int32_t)gapSize;
+
+            out.push_back(frontRun);
+            out.push_back(backRun);
+        } else {
+            // A run ending on the gap keeps its end at gap begin, and one beginning on the gap gets moved to gap end.
+            // This way we have a contiguous segment of text again.
+            if (run.begin >= gapBegin) {
+                run.begin += (int32_t)gapSize;
+                run.end += (int32_t)gapSize;
+            }
+            out.push_back(run);
+        }
+    }
+}
+
+// Format: for each TextRun, as LEB128 varints, the distance from the previous run's end to its begin, and its length.
+// Then one byte for TextStyle::type and one byte of flags. Typically ~4 bytes per TextRun.
+enum : uint8_t {
+    kSerializedMonospace = 1 << 0,
+    kSerializedBold = 1 << 1,
+    kSerializedItalic = 1 << 2,
+    kSerializedUnderline = 1 << 3,
+    kSerializedStrikethrough = 1 << 4,
+    kSerializedParagraphBreak = 1 << 5,
+};
+
+static void WriteVarint(std::vector<uint8_t>& out, uint64_t n) {
+    while (n >= 0x80) {
+        out.push_back((uint8_t)(n | 0x80));
+        n >>= 7;
+    }
+    out.push_back((uint8_t)n);
+}
+
+static bool ReadVarint(std::span<const uint8_t>& data, uint64_t& n) {
+    n = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (data.empty()) {
+            return false;
+        }
+        uint8_t byte = data[0];
+        data = data.subspan(1);
+        n |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Ionl::SerializeTextRuns(const std::vector<TextRun>& logicalRuns, std::vector<uint8_t>& out) {
+    out.clear();
+
+    int64_t prevEnd = 0;
+    for (auto& run : logicalRuns) {
+        WriteVarint(out, run.begin - prevEnd);
+        WriteVarint(out, run.end - run.begin);
+        prevEnd = run.end;
+
+        uint8_t flags = 0;
+        if (run.style.isMonospace) flags |= kSerializedMonospace;
+        if (run.style.isBold) flags |= kSerializedBold;
+        if (run.style.isItalic) flags |= kSerializedItalic;
+        if (run.style.isUnderline) flags |= kSerializedUnderline;
+        if (run.style.isStrikethrough) flags |= kSerializedStrikethrough;
+        if (run.hasParagraphBreak) flags |= kSerializedParagraphBreak;
+        out.push_back((uint8_t)run.style.type);
+        out.push_back(flags);
+    }
+}
+
+bool Ionl::DeserializeTextRuns(std::span<const uint8_t> data, int64_t contentSize, std::vector<TextRun>& out) {
+    out.clear();
+
+    int64_t prevEnd = 0;
+    while (!data.empty()) {
+        uint64_t skip, length;
+        if (!ReadVarint(data, skip) || !ReadVarint(data, length) || data.size() < 2) {
+            return false;
+        }
+        // NOTE: compare one at a time, the sum may overflow on garbage input
+        if (skip > (uint64_t)(contentSize - prevEnd) || length > (uint64_t)(contentSize - prevEnd - (int64_t)skip)) {
+            return false;
+        }
+        uint8_t type = data[0];
+        uint8_t flags = data[1];
+        data = data.subspan(2);
+        if (type >= (uint8_t)TextStyleType::Title_END) {
+            return false;
+        }
+
+        TextRun run;
+        run.begin = (int32_t)(prevEnd + (int64_t)skip);
+        run.end = (int32_t)(run.begin + (int64_t)length);
+        run.style.type = (TextStyleType)type;
+        run.style.isMonospace = flags & kSerializedMonospace;
+        run.style.isBold = flags & kSerializedBold;
+        run.style.isItalic = flags & kSerializedItalic;
+        run.style.isUnderline = flags & kSerializedUnderline;
+        run.style.isStrikethrough = flags & kSerializedStrikethrough;
+        run.hasParagraphBreak = flags & kSerializedParagraphBreak;
+        out.push_back(run);
+        prevEnd = run.end;
+    }
+    return true;
+}
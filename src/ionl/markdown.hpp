@@ -4,11 +4,13 @@
 #include <ionl/gap_buffer.hpp>
 
 #include <cstdint>
+#include <span>
 #include <vector>
 
 namespace Ionl {
 
-enum class TextStyleType : char {
+// NOTE: unsigned, TextStyle stores this in a 3-bit bitfield
+enum class TextStyleType : uint8_t {
     Regular,
     Url,
     Title_BEGIN,
@@ -21,7 +23,7 @@ enum class TextStyleType : char {
 };
 
 constexpr int kNumTitleLevels =
-    static_cast<char>(TextStyleType::Title_END) - static_cast<char>(TextStyleType::Title_BEGIN);
+    static_cast<int>(TextStyleType::Title_END) - static_cast<int>(TextStyleType::Title_BEGIN);
 
 // Heading level: number of #'s used in writing this heading
 // e.g. # Heading -> 1
@@ -30,24 +32,35 @@ int CalcHeadingLevel(TextStyleType type);
 TextStyleType MakeHeadingLevel(int level);
 bool IsHeading(TextStyleType type);
 
+// NOTE: TextStyle and TextRun are packed, there is one of each for every formatting change in every loaded bullet, and
+//       one more per laid out line (in GlyphRun)
+
 struct TextStyle {
-    TextStyleType type;
+    TextStyleType type : 3;
 
     // Face variants
-    bool isMonospace;
-    bool isBold;
-    bool isItalic;
+    bool isMonospace : 1;
+    bool isBold : 1;
+    bool isItalic : 1;
     // Decorations
-    bool isUnderline;
-    bool isStrikethrough;
+    bool isUnderline : 1;
+    bool isStrikethrough : 1;
+
+    bool operator==(const TextStyle&) const = default;
 };
+static_assert(sizeof(TextStyle) == 1);
+static_assert(static_cast<int>(TextStyleType::Title_END) <= 1 << 3);
 
 struct TextRun {
-    int64_t begin = 0; // Buffer index
-    int64_t end = 0; // Buffer index
+    // 32-bit: a single bullet's buffer never gets anywhere close to 2^31 characters
+    int32_t begin = 0; // Buffer index
+    int32_t end = 0; // Buffer index
     TextStyle style = {};
     bool hasParagraphBreak = false; // Whether to break paragraph at end of this TextRun
+
+    bool operator==(const TextRun&) const = default;
 };
+static_assert(sizeof(TextRun) == 12);
 
 struct MarkdownFace {
     // [Required]
@@ -79,5 +92,42 @@ extern MarkdownStylesheet gMarkdownStylesheet;
 // Note, this also includes the two cases (1) run ends on the gap => run.end == gapBegin; (2) run begins on the gap => run.begin == gapEnd.
 // Case (1) will never have run.end == gapEnd and case (2) will never have run.begin == gapBegin, even though this is the same thing in logical index.
 std::vector<TextRun> ParseMarkdownBuffer(const GapBuffer& src);
+/// Same as above, but writes into `out` (replacing its content) and reuses a per-thread MarkdownParser, so that it
+/// doesn't allocate once the storage involved has grown large enough.
+void ParseMarkdownBuffer(const GapBuffer& src, std::vector<TextRun>& out);
+
+struct MarkdownToken;
+
+/// Parsing state that persists across calls. Scratch storage is kept around, so that parsing over and over again (e.g.
+/// on every keystroke) doesn't allocate once it has grown large enough. Meant to be owned per TextBuffer or per thread.
+struct MarkdownParser {
+    std::vector<MarkdownToken> tokens;
+
+    MarkdownParser();
+    MarkdownParser(MarkdownParser&&) noexcept;
+    MarkdownParser& operator=(MarkdownParser&&) noexcept;
+    ~MarkdownParser();
+
+    /// Parse all paragraphs overlapping the logical range [begin, end], appending TextRun's to `out`.
+    /// Inline formatting never extends past a paragraph, so each paragraph is parsed on its own; this is what makes
+    /// reparsing only the edited paragraphs possible (see TextBuffer). Unlike ParseMarkdownBuffer(), the TextRun's use
+    /// logical indices and are not split at the gap.
+    void ParseParagraphs(const GapBuffer& src, int64_t begin, int64_t end, std::vector<TextRun>& out);
+};
+
+/// Convert TextRun's in logical indices to buffer indices, splitting them at the gap as ParseMarkdownBuffer() does.
+/// `out` is replaced.
+void MapTextRunsToBuffer(const GapBuffer& src, const std::vector<TextRun>& logicalRuns, std::vector<TextRun>& out);
+
+/// Bump whenever the TextRun's produced for the same text change (e.g. a parsing fix or new syntax), or the format of
+/// SerializeTextRuns() does. TextRun's persisted by another version are then ignored.
+constexpr int kMarkdownParserVersion = 1;
+
+/// Compact form of TextRun's in logical indices, for persisting them (see IBackingStore::StoreCachedTextRuns()).
+/// `out` is replaced.
+void SerializeTextRuns(const std::vector<TextRun>& logicalRuns, std::vector<uint8_t>& out);
+/// \param contentSize Size of the text the TextRun's were parsed from, data that doesn't fit in it is rejected.
+/// \return Whether `data` is well-formed. If not, `out` is left with unspecified content.
+bool DeserializeTextRuns(std::span<const uint8_t> data, int64_t contentSize, std::vector<TextRun>& out);
 
 } // namespace Ionl
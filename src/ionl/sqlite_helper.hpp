@@ -5,6 +5,7 @@
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string_view>
@@ -101,6 +102,10 @@ struct SQLiteRunningStatement {
         sqlite3_bind_text(stmt, index, value.data(), value.size(), nullptr);
     }
 
+    void BindArgument(int index, std::span<const uint8_t> value) {
+        sqlite3_bind_blob(stmt, index, value.data(), value.size(), nullptr);
+    }
+
     void BindArgument(int index, std::nullptr_t) {
         // Noop
     }
@@ -160,6 +165,10 @@ struct SQLiteRunningStatement {
             return (T)sqlite3_column_int64(stmt, column);
         } else if constexpr (std::is_same_v<T, const char*>) {
             return (const char*)sqlite3_column_text(stmt, column);
+        } else if constexpr (std::is_same_v<T, std::span<const uint8_t>>) {
+            // NOTE: sqlite3_column_bytes() must be called after sqlite3_column_blob(), see SQLite docs
+            auto data = (const uint8_t*)sqlite3_column_blob(stmt, column);
+            return std::span<const uint8_t>(data, sqlite3_column_bytes(stmt, column));
         } else if constexpr (std::is_same_v<T, std::string>) {
             auto cstr = (const char*)sqlite3_column_text(stmt, column);
             return std::string(cstr);
@@ -1,5 +1,8 @@
 #include "text_buffer.hpp"
 
+#include <algorithm>
+#include <cassert>
+
 int Ionl::CalcHeadingLevel(TextStyleType type) {
     auto n = static_cast<int>(type);
     return n - static_cast<int>(TextStyleType::Title_BEGIN) + 1;
@@ -19,14 +22,120 @@ bool Ionl::IsHeading(TextStyleType type) {
         n < static_cast<int>(TextStyleType::Title_END);
 }
 
-Ionl::TextBuffer::TextBuffer(GapBuffer buf)
+Ionl::TextBufferParseResult Ionl::ParseSnapshot(const TextBufferSnapshot& snapshot, MarkdownParser& parser) {
+    auto& buf = *snapshot.gapBuffer;
+    TextBufferParseResult result{
+        .logicalTextRuns = {},
+        .contentSize = buf.GetContentSize(),
+        .cacheDataVersion = snapshot.cacheDataVersion,
+    };
+    parser.ParseParagraphs(buf, 0, result.contentSize, result.logicalTextRuns);
+    return result;
+}
+
+Ionl::TextBuffer::TextBuffer(GapBuffer buf, int64_t undoByteLimit, bool deferParse)
     : gapBuffer{ std::move(buf) } //
 {
+    // Bullets are loaded packed, we need the actual gap buffer for editing and parsing
+    gapBuffer.Unpack();
+    gapBuffer.undoJournal = std::make_unique<UndoJournal>(undoByteLimit);
+    if (!deferParse) {
+        RefreshCaches();
+    }
+}
+
+Ionl::TextBuffer::TextBuffer(GapBuffer buf, std::vector<TextRun> cachedLogicalTextRuns, int64_t undoByteLimit)
+    : TextBuffer(std::move(buf), undoByteLimit, /*deferParse*/ true) //
+{
+    logicalTextRuns = std::move(cachedLogicalTextRuns);
+    parsedContentSize = gapBuffer.GetContentSize();
+    gapBuffer.ResetDirtyRange();
+    // Nothing to reparse, this only maps them to buffer indices
     RefreshCaches();
 }
 
 void Ionl::TextBuffer::RefreshCaches() {
-    textRuns = ParseMarkdownBuffer(gapBuffer);
+    auto& buf = gapBuffer;
+    int64_t contentSize = buf.GetContentSize();
+
+    // Nothing reparsed, unless one of the branches below says otherwise
+    auto& change = lastChange;
+    change.begin = 0;
+    change.end = -1;
+    change.delta = 0;
+    change.prevGapBegin = mappedGapBegin;
+    change.prevGapSize = mappedGapSize;
+
+    if (parsedContentSize == -1) {
+        logicalTextRuns.clear();
+        markdownParser.ParseParagraphs(buf, 0, contentSize, logicalTextRuns);
+        change.prevGapBegin = -1;
+    } else if (buf.isDirty) {
+        int64_t delta = contentSize - parsedContentSize;
+
+        // Formatting doesn't extend past a paragraph, so the edits can only affect the paragraphs they touched.
+        // Everything outside of [dirtyBegin, dirtyEnd] is the same text as before, at an offset of `delta` after it.
+        int64_t dirtyBegin = GetParagraphBegin(buf, FindParagraphContaining(buf, buf.unchangedPrefix));
+        int64_t dirtyEnd = GetParagraphEnd(buf, FindParagraphContaining(buf, contentSize - buf.unchangedSuffix));
+        int64_t oldDirtyEnd = dirtyEnd - delta;
+
+        auto lo = std::partition_point(logicalTextRuns.begin(), logicalTextRuns.end(), [&](const TextRun& run) { return run.begin < dirtyBegin; });
+        auto hi = std::partition_point(lo, logicalTextRuns.end(), [&](const TextRun& run) { return run.begin <= oldDirtyEnd; });
+        for (auto it = hi; it != logicalTextRuns.end(); ++it) {
+            it->begin += (int32_t)delta;
+            it->end += (int32_t)delta;
+        }
+
+        auto& reparsed = reparsedTextRuns;
+        reparsed.clear();
+        markdownParser.ParseParagraphs(buf, dirtyBegin, dirtyEnd, reparsed);
+
+        // Overwrite the old TextRun's in place, only the difference in count needs to shift the ones after. When typing
+        // plain text, the count usually stays the same.
+        auto numReplaced = std::min<size_t>(hi - lo, reparsed.size());
+        auto it = std::copy_n(reparsed.begin(), numReplaced, lo);
+        if (it != hi) {
+            logicalTextRuns.erase(it, hi);
+        } else {
+            logicalTextRuns.insert(it, reparsed.begin() + numReplaced, reparsed.end());
+        }
+
+        change.begin = dirtyBegin;
+        change.end = dirtyEnd;
+        change.delta = delta;
+    }
+    buf.ResetDirtyRange();
+    parsedContentSize = contentSize;
+
+    // The gap may have moved even without any edits, always redo this. It's a lot cheaper than parsing.
+    MapTextRunsToBuffer(buf, logicalTextRuns, textRuns);
+    mappedGapBegin = buf.GetGapBegin();
+    mappedGapSize = buf.GetGapSize();
     cacheDataVersion += 1;
 }
 
+
+Ionl::TextBufferSnapshot Ionl::TextBuffer::TakeSnapshot() {
+    return TextBufferSnapshot{
+        .gapBuffer = Ionl::TakeSnapshot(gapBuffer),
+        .cacheDataVersion = cacheDataVersion,
+    };
+}
+
+Ionl::TextBufferSnapshot Ionl::TextBuffer::TakeSnapshotForParsing() {
+    assert(parsedContentSize == -1);
+    // The result will describe the content as of now, so only edits made after this need to be reparsed on top of it
+    gapBuffer.ResetDirtyRange();
+    return TakeSnapshot();
+}
+
+bool Ionl::TextBuffer::ApplyParseResult(TextBufferParseResult&& result) {
+    if (parsedContentSize != -1 || result.cacheDataVersion != cacheDataVersion) {
+        return false;
+    }
+
+    logicalTextRuns = std::move(result.logicalTextRuns);
+    parsedContentSize = result.contentSize;
+    RefreshCaches();
+    return true;
+}
@@ -3,13 +3,47 @@
 #include <imgui/imgui.h>
 #include <ionl/gap_buffer.hpp>
 #include <ionl/markdown.hpp>
+#include <ionl/undo_journal.hpp>
 
+#include <memory>
 #include <string>
 #include <string_view>
 #include <vector>
 
 namespace Ionl {
 
+/// Immutable copy of a TextBuffer's content, for parsing/saving/indexing on another thread. See TakeSnapshot(GapBuffer&).
+struct TextBufferSnapshot {
+    std::shared_ptr<const GapBuffer> gapBuffer;
+    // TextBuffer::cacheDataVersion at the time the snapshot was taken, to tell whether results computed from the
+    // snapshot are still up to date
+    int cacheDataVersion;
+};
+
+/// TextRun's parsed from a TextBufferSnapshot on another thread, see TextBuffer::ApplyParseResult().
+struct TextBufferParseResult {
+    std::vector<TextRun> logicalTextRuns;
+    int64_t contentSize;
+    int cacheDataVersion;
+};
+
+/// Safe to call on any thread.
+TextBufferParseResult ParseSnapshot(const TextBufferSnapshot& snapshot, MarkdownParser& parser);
+
+/// What a call to TextBuffer::RefreshCaches() changed in `textRuns`, so that data derived from them (e.g. TextEdit's
+/// layout) can be updated from the previous version instead of being computed again.
+struct TextRunsChange {
+    // Logical range [begin, end] of the paragraphs that got reparsed, in the current content. Empty if begin > end.
+    // Everything after it moved by `delta`.
+    int64_t begin = 0;
+    int64_t end = -1;
+    int64_t delta = 0;
+    // Gap of the buffer `textRuns` were mapped to in the previous version, or -1 if there was no previous version (they
+    // were all computed from scratch).
+    int64_t prevGapBegin = -1;
+    int64_t prevGapSize = 0;
+};
+
 struct TextBuffer {
     // Canonical data
     GapBuffer gapBuffer;
@@ -18,10 +52,42 @@ struct TextBuffer {
     // Invalidation and recomputation should be done by whoever modifies `gapBuffer`.
     std::vector<TextRun> textRuns;
     int cacheDataVersion = 0;
+    // Going from `cacheDataVersion - 1` to the current version
+    TextRunsChange lastChange;
+
+    // Same as `textRuns`, but in logical indices and not split at the gap. This is what edits get spliced into, so that
+    // only the edited paragraphs need to be reparsed.
+    std::vector<TextRun> logicalTextRuns;
+    // Content size at the time `logicalTextRuns` got updated, or -1 if they have never been computed
+    int64_t parsedContentSize = -1;
+    // Gap of the buffer at the time `textRuns` got mapped to it, or -1 if they have never been computed
+    int64_t mappedGapBegin = -1;
+    int64_t mappedGapSize = 0;
 
-    explicit TextBuffer(GapBuffer buf);
+    // Reused by RefreshCaches(), so that typing doesn't allocate on every keystroke
+    MarkdownParser markdownParser;
+    std::vector<TextRun> reparsedTextRuns;
 
+    /// \param undoByteLimit Memory limit of the undo history, see GapBuffer::undoJournal
+    /// \param deferParse If true, cached data is left empty, to be computed on another thread (see
+    ///                   TakeSnapshotForParsing()) or by the first call to RefreshCaches().
+    explicit TextBuffer(GapBuffer buf, int64_t undoByteLimit = kDefaultUndoJournalByteLimit, bool deferParse = false);
+    /// Use TextRun's computed earlier for the same content (e.g. persisted by IBackingStore::StoreCachedTextRuns())
+    /// instead of parsing it again.
+    /// \param cachedLogicalTextRuns In logical indices, see `logicalTextRuns`.
+    TextBuffer(GapBuffer buf, std::vector<TextRun> cachedLogicalTextRuns, int64_t undoByteLimit = kDefaultUndoJournalByteLimit);
+
+    /// Update cached data for the edits made to `gapBuffer` since the last call, see GapBuffer::isDirty.
     void RefreshCaches();
+    TextBufferSnapshot TakeSnapshot();
+
+    /// For a TextBuffer whose cached data has never been computed: take a snapshot to be parsed on another thread with
+    /// ParseSnapshot(). Edits made after this are tracked as usual, so the result stays usable even if they happen.
+    TextBufferSnapshot TakeSnapshotForParsing();
+    /// Adopt the result of parsing a snapshot from TakeSnapshotForParsing(), and reparse any paragraphs edited since
+    /// then on top of it. The result is discarded if RefreshCaches() has computed everything already.
+    /// \return Whether the result got used.
+    bool ApplyParseResult(TextBufferParseResult&& result);
 };
 
 } // namespace Ionl
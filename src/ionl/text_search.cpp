@@ -0,0 +1,220 @@
+#include "text_search.hpp"
+
+#include <ionl/utf8.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    define IONL_SEARCH_SSE2 1
+#    include <emmintrin.h>
+#else
+#    define IONL_SEARCH_SSE2 0
+#endif
+
+using namespace Ionl;
+
+namespace {
+// Unpacked buffers are searched as ImWchar's, packed buffers are searched as UTF-8 bytes. Since only ASCII gets folded
+// in case insensitive mode, and a valid UTF-8 sequence can only ever match at a codepoint boundary, both give the same
+// results. The exception is U+FFFD, which stands for any character outside the BMP once unpacked, while packed UTF-8
+// still has the original 4 byte sequence; patterns containing it are rejected up front. Without it in the pattern, such
+// a sequence can't be part of a match in either form.
+using Utf8Byte = unsigned char;
+
+template <typename TChar>
+TChar FoldAscii(TChar c) {
+    return c >= 'A' && c <= 'Z' ? (TChar)(c + ('a' - 'A')) : c;
+}
+
+template <typename TChar>
+bool MatchesAt(const TChar* p, const TChar* needle, size_t needleSize, bool caseInsensitive) {
+    if (!caseInsensitive) {
+        return memcmp(p, needle, needleSize * sizeof(TChar)) == 0;
+    }
+    for (size_t i = 0; i < needleSize; ++i) {
+        if (FoldAscii(p[i]) != needle[i]) return false;
+    }
+    return true;
+}
+
+#if IONL_SEARCH_SSE2
+template <typename TChar>
+__m128i Splat(TChar c) {
+    if constexpr (sizeof(TChar) == 1) {
+        return _mm_set1_epi8((char)c);
+    } else {
+        return _mm_set1_epi16((short)c);
+    }
+}
+
+template <typename TChar>
+__m128i CompareEqual(__m128i a, __m128i b) {
+    if constexpr (sizeof(TChar) == 1) {
+        return _mm_cmpeq_epi8(a, b);
+    } else {
+        return _mm_cmpeq_epi16(a, b);
+    }
+}
+
+template <typename TChar>
+__m128i FoldAsciiBlock(__m128i v) {
+    // NOTE: the signed comparisons are fine here, anything that is not ASCII (high bit set in the byte for UTF-8 / in the
+    // 16-bit lane for ImWchar) compares as negative, and therefore not in range
+    __m128i isUpper;
+    if constexpr (sizeof(TChar) == 1) {
+        isUpper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    } else {
+        isUpper = _mm_and_si128(_mm_cmpgt_epi16(v, _mm_set1_epi16('A' - 1)), _mm_cmplt_epi16(v, _mm_set1_epi16('Z' + 1)));
+    }
+    return _mm_or_si128(v, _mm_and_si128(isUpper, Splat<TChar>(0x20)));
+}
+#endif
+
+// Find the first position in [begin, end) where the whole needle fits and matches.
+// Candidates are filtered by comparing both the first and the last character of the needle against a block of positions
+// at once, only the survivors are fully compared.
+template <typename TChar>
+const TChar* FindInSegment(const TChar* begin, const TChar* end, const TChar* needle, size_t needleSize, bool caseInsensitive) {
+    if ((size_t)(end - begin) < needleSize) {
+        return nullptr;
+    }
+    const TChar* lastStart = end - needleSize;
+    const TChar* p = begin;
+
+#if IONL_SEARCH_SSE2
+    constexpr int kLanes = 16 / sizeof(TChar);
+    // Each lane produces sizeof(TChar) bits in _mm_movemask_epi8()
+    constexpr int kLaneBits = (1 << sizeof(TChar)) - 1;
+
+    __m128i first = Splat(needle[0]);
+    __m128i last = Splat(needle[needleSize - 1]);
+    while (lastStart - p >= kLanes - 1) {
+        __m128i a = _mm_loadu_si128((const __m128i*)p);
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + needleSize - 1));
+        if (caseInsensitive) {
+            a = FoldAsciiBlock<TChar>(a);
+            b = FoldAsciiBlock<TChar>(b);
+        }
+
+        int mask = _mm_movemask_epi8(_mm_and_si128(CompareEqual<TChar>(a, first), CompareEqual<TChar>(b, last)));
+        while (mask != 0) {
+            int bit = std::countr_zero((unsigned)mask);
+            auto candidate = p + bit / sizeof(TChar);
+            if (MatchesAt(candidate, needle, needleSize, caseInsensitive)) {
+                return candidate;
+            }
+            mask &= ~(kLaneBits << bit);
+        }
+        p += kLanes;
+    }
+#endif
+
+    for (; p <= lastStart; ++p) {
+        if (MatchesAt(p, needle, needleSize, caseInsensitive)) {
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+int64_t FindNextMatchPacked(const PackedUtf8Content& content, const SearchPattern& pattern, int64_t fromIdx) {
+    auto strBegin = (const Utf8Byte*)content.utf8.data();
+    auto strEnd = strBegin + content.utf8.size();
+    auto from = strBegin + MapLogicalIndexToUtf8Offset(content, fromIdx);
+
+    auto match = FindInSegment(from, strEnd, (const Utf8Byte*)pattern.utf8.data(), pattern.utf8.size(), pattern.caseInsensitive);
+    if (!match) {
+        return -1;
+    }
+    return MapUtf8OffsetToLogicalIndex(content, match - strBegin);
+}
+
+int64_t FindNextMatchUnpacked(const GapBuffer& buf, const SearchPattern& pattern, int64_t fromIdx) {
+    auto needle = pattern.text.data();
+    auto needleSize = (int64_t)pattern.text.size();
+    bool caseInsensitive = pattern.caseInsensitive;
+
+    int64_t frontSize = buf.GetFrontSize();
+    int64_t contentSize = buf.GetContentSize();
+
+    // Matches entirely inside front
+    if (fromIdx < frontSize) {
+        auto match = FindInSegment<ImWchar>(buf.buffer + fromIdx, buf.buffer + frontSize, needle, needleSize, caseInsensitive);
+        if (match) {
+            return match - buf.buffer;
+        }
+    }
+
+    // Matches straddling the gap: there are at most needleSize - 1 of these, compare them one by one
+    int64_t straddleBegin = std::max({ fromIdx, frontSize - needleSize + 1, (int64_t)0 });
+    int64_t straddleEnd = std::min(frontSize, contentSize - needleSize + 1);
+    for (int64_t i = straddleBegin; i < straddleEnd; ++i) {
+        bool matches = true;
+        for (int64_t j = 0; j < needleSize; ++j) {
+            ImWchar c = buf.buffer[MapLogicalIndexToBufferIndex(buf, i + j)];
+            if ((caseInsensitive ? FoldAscii(c) : c) != needle[j]) {
+                matches = false;
+                break;
+            }
+        }
+        if (matches) {
+            return i;
+        }
+    }
+
+    // Matches entirely inside back
+    int64_t backFrom = std::max(fromIdx, frontSize);
+    auto backBegin = buf.buffer + buf.GetBackBegin();
+    auto backEnd = buf.buffer + buf.GetBackEnd();
+    auto match = FindInSegment<ImWchar>(backBegin + (backFrom - frontSize), backEnd, needle, needleSize, caseInsensitive);
+    if (match) {
+        return frontSize + (match - backBegin);
+    }
+
+    return -1;
+}
+} // namespace
+
+Ionl::SearchPattern::SearchPattern(std::string_view query, bool caseInsensitive)
+    : caseInsensitive{ caseInsensitive } //
+{
+    auto strBegin = query.data();
+    auto strEnd = query.data() + query.size();
+    text.resize(Utf8CountCodepoints(strBegin, strEnd));
+    Utf8Decode(text.data(), (int64_t)text.size(), strBegin, strEnd);
+    hasReplacementChar = std::find(text.begin(), text.end(), (ImWchar)IM_UNICODE_CODEPOINT_INVALID) != text.end();
+
+    // Re-encode instead of copying `query`, so that both forms agree on how invalid UTF-8 gets handled
+    utf8.resize(Utf8CountBytes(text.data(), text.data() + text.size()));
+    Utf8Encode(utf8.data(), text.data(), text.data() + text.size());
+
+    if (caseInsensitive) {
+        for (auto& c : text) c = FoldAscii(c);
+        for (auto& c : utf8) c = (char)FoldAscii((Utf8Byte)c);
+    }
+}
+
+int64_t Ionl::FindNextMatch(const GapBuffer& buf, const SearchPattern& pattern, int64_t fromIdx) {
+    if (pattern.IsEmpty() || pattern.hasReplacementChar || fromIdx < 0 || fromIdx >= buf.GetContentSize()) {
+        return -1;
+    }
+
+    if (buf.IsPacked()) {
+        return FindNextMatchPacked(*buf.packed, pattern, fromIdx);
+    } else {
+        return FindNextMatchUnpacked(buf, pattern, fromIdx);
+    }
+}
+
+int64_t Ionl::FindAllMatches(const GapBuffer& buf, const SearchPattern& pattern, std::vector<int64_t>& out) {
+    int64_t count = 0;
+    int64_t idx = FindNextMatch(buf, pattern, 0);
+    while (idx != -1) {
+        out.push_back(idx);
+        count += 1;
+        idx = FindNextMatch(buf, pattern, idx + (int64_t)pattern.text.size());
+    }
+    return count;
+}
@@ -0,0 +1,41 @@
+// Substring search over GapBuffer content, for both find-in-bullet and scanning all loaded bullets of a document.
+#pragma once
+
+#include <imgui/imgui.h>
+#include <ionl/gap_buffer.hpp>
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Ionl {
+
+/// A search query, prepared once and then used on as many buffers as needed.
+struct SearchPattern {
+    // Query decoded to codepoints, for searching unpacked buffers
+    std::vector<ImWchar> text;
+    // Query as UTF-8, for searching packed buffers without unpacking them
+    std::string utf8;
+    // Only ASCII letters are folded, anything else has to match exactly
+    bool caseInsensitive;
+    // The query contains U+FFFD, either as is, or from characters outside the BMP or invalid UTF-8. Once unpacked, all of
+    // these are indistinguishable in the buffer, but not in packed UTF-8; such a query matches nothing in either.
+    bool hasReplacementChar = false;
+
+    SearchPattern(std::string_view query, bool caseInsensitive = false);
+
+    bool IsEmpty() const { return text.empty(); }
+};
+
+/// Find the first match that begins at or after `fromIdx`. Works on both packed and unpacked buffers, and matches may
+/// straddle the gap. Characters outside the BMP in the buffer are never part of a match (see
+/// SearchPattern::hasReplacementChar), so that both give the same results.
+/// \return Logical index of the beginning of the match, or -1 if there is none (or the pattern is empty).
+int64_t FindNextMatch(const GapBuffer& buf, const SearchPattern& pattern, int64_t fromIdx = 0);
+
+/// Find all non-overlapping matches, in ascending order, appending their logical indices to `out`.
+/// \return Number of matches found.
+int64_t FindAllMatches(const GapBuffer& buf, const SearchPattern& pattern, std::vector<int64_t>& out);
+
+} // namespace Ionl
@@ -0,0 +1,188 @@
+#include "undo_journal.hpp"
+
+#include <ionl/gap_buffer.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+using namespace Ionl;
+
+namespace {
+// Try to merge a keystroke-like edit (pure insertion or pure deletion) into `entry`, so that it is undone together with
+// it. Only edits right at the end of the text the entry inserted are merged.
+bool TryCoalesce(UndoEntry& entry, int64_t position, const ImWchar* removed, size_t removedSize, const ImWchar* inserted, size_t insertedSize) {
+    int64_t insertedEnd = entry.position + (int64_t)entry.inserted.size();
+
+    // Typing
+    if (removedSize == 0 && position == insertedEnd) {
+        entry.inserted.insert(entry.inserted.end(), inserted, inserted + insertedSize);
+        return true;
+    }
+    if (insertedSize != 0) {
+        return false;
+    }
+
+    // Backspace: eat into the text this entry inserted first, and then into the text before it
+    if (position + (int64_t)removedSize == insertedEnd) {
+        size_t eaten = std::min(removedSize, entry.inserted.size());
+        entry.inserted.resize(entry.inserted.size() - eaten);
+        size_t remaining = removedSize - eaten;
+        entry.removed.insert(entry.removed.begin(), removed, removed + remaining);
+        entry.position -= (int64_t)remaining;
+        return true;
+    }
+
+    // Forward delete
+    if (position == insertedEnd) {
+        entry.removed.insert(entry.removed.end(), removed, removed + removedSize);
+        return true;
+    }
+
+    return false;
+}
+
+void EnforceByteLimit(UndoJournal& journal) {
+    while (journal.byteSize > journal.byteLimit && !journal.undoEntries.empty()) {
+        // Drop whole groups, partially undoing one would produce text that never existed
+        do {
+            journal.byteSize -= journal.undoEntries.front().GetByteSize();
+            journal.undoEntries.pop_front();
+        } while (!journal.undoEntries.empty() && journal.undoEntries.front().joinWithPrevious);
+    }
+    if (journal.undoEntries.empty()) {
+        journal.canCoalesce = false;
+    }
+}
+
+void ReplaceAt(GapBuffer& buf, int64_t position, size_t deleteSize, const std::vector<ImWchar>& text) {
+    MoveGapToLogicalIndex(buf, position);
+    DeleteFromGap(buf, (int64_t)deleteSize);
+    if (!text.empty()) {
+        InsertAtGap(buf, text.data(), text.size());
+    }
+}
+} // namespace
+
+int64_t Ionl::UndoEntry::GetByteSize() const {
+    return (int64_t)(sizeof(UndoEntry) + (removed.capacity() + inserted.capacity()) * sizeof(ImWchar));
+}
+
+Ionl::UndoJournal::UndoJournal(int64_t byteLimit)
+    : byteLimit{ byteLimit } //
+{
+}
+
+void Ionl::UndoJournal::Clear() {
+    undoEntries.clear();
+    redoEntries.clear();
+    byteSize = 0;
+    canCoalesce = false;
+}
+
+void Ionl::UndoJournal::BeginGroup() {
+    if (groupDepth++ == 0) {
+        hasGroupEntry = false;
+        canCoalesce = false;
+    }
+}
+
+void Ionl::UndoJournal::EndGroup() {
+    assert(groupDepth > 0);
+    if (--groupDepth == 0) {
+        canCoalesce = false;
+    }
+}
+
+void Ionl::RecordEdit(UndoJournal& journal, int64_t position, const ImWchar* removed, size_t removedSize, const ImWchar* inserted, size_t insertedSize) {
+    if (journal.isReplaying) return;
+    if (removedSize == 0 && insertedSize == 0) return;
+    bool joinWithPrevious = journal.groupDepth > 0 && journal.hasGroupEntry;
+    // The beginning of this group has already been dropped by EnforceByteLimit(), the rest of it is useless
+    if (joinWithPrevious && journal.undoEntries.empty()) return;
+
+    // A new edit makes everything that has been undone unreachable
+    for (auto& entry : journal.redoEntries) {
+        journal.byteSize -= entry.GetByteSize();
+    }
+    journal.redoEntries.clear();
+
+    bool coalesced = false;
+    if (journal.canCoalesce && !joinWithPrevious && !journal.undoEntries.empty()) {
+        auto& last = journal.undoEntries.back();
+        journal.byteSize -= last.GetByteSize();
+        coalesced = TryCoalesce(last, position, removed, removedSize, inserted, insertedSize);
+        if (last.removed.empty() && last.inserted.empty()) {
+            // e.g. typed some characters, and then backspaced all of them
+            journal.undoEntries.pop_back();
+            journal.canCoalesce = false;
+            return;
+        }
+        journal.byteSize += last.GetByteSize();
+    }
+
+    if (!coalesced) {
+        UndoEntry entry{
+            .position = position,
+            .removed = std::vector<ImWchar>(removed, removed + removedSize),
+            .inserted = std::vector<ImWchar>(inserted, inserted + insertedSize),
+            .joinWithPrevious = joinWithPrevious,
+        };
+        journal.byteSize += entry.GetByteSize();
+        journal.undoEntries.push_back(std::move(entry));
+    }
+    journal.canCoalesce = true;
+    if (journal.groupDepth > 0) {
+        journal.hasGroupEntry = true;
+    }
+
+    EnforceByteLimit(journal);
+}
+
+int64_t Ionl::Undo(UndoJournal& journal, GapBuffer& buf) {
+    if (journal.undoEntries.empty()) return -1;
+
+    journal.isReplaying = true;
+    int64_t cursor;
+    bool isGroupContinued;
+    do {
+        auto entry = std::move(journal.undoEntries.back());
+        journal.undoEntries.pop_back();
+
+        ReplaceAt(buf, entry.position, entry.inserted.size(), entry.removed);
+        cursor = entry.position + (int64_t)entry.removed.size();
+        isGroupContinued = entry.joinWithPrevious;
+
+        journal.redoEntries.push_back(std::move(entry));
+    } while (isGroupContinued && !journal.undoEntries.empty());
+    journal.isReplaying = false;
+    journal.canCoalesce = false;
+
+    return cursor;
+}
+
+int64_t Ionl::Redo(UndoJournal& journal, GapBuffer& buf) {
+    if (journal.redoEntries.empty()) return -1;
+
+    journal.isReplaying = true;
+    int64_t cursor;
+    do {
+        auto entry = std::move(journal.redoEntries.back());
+        journal.redoEntries.pop_back();
+
+        ReplaceAt(buf, entry.position, entry.removed.size(), entry.inserted);
+        cursor = entry.position + (int64_t)entry.inserted.size();
+
+        journal.undoEntries.push_back(std::move(entry));
+    } while (!journal.redoEntries.empty() && journal.redoEntries.back().joinWithPrevious);
+    journal.isReplaying = false;
+    journal.canCoalesce = false;
+
+    return cursor;
+}
+
+void Ionl::ShowUndoJournal(const UndoJournal& journal) {
+    ImGui::Text("Undo entries: %zu, redo entries: %zu", journal.undoEntries.size(), journal.redoEntries.size());
+    ImGui::Text("Memory: %lld / %lld KiB", (long long)journal.byteSize / 1024, (long long)journal.byteLimit / 1024);
+    ImGui::Text("Coalescing: %s", journal.canCoalesce ? "yes" : "no");
+}
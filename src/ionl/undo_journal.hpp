@@ -0,0 +1,81 @@
+// Undo/redo history of a GapBuffer, recorded as the edits happen (see GapBuffer::undoJournal).
+//
+// Each entry is a delta: "at this position, this text got replaced by that text". Only the text that actually changed
+// is stored, so memory grows with the amount of editing rather than with buffer size × number of edits. Consecutive
+// keystrokes (typing, backspacing, forward deleting at the same spot) are coalesced into a single entry.
+#pragma once
+
+#include <imgui/imgui.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace Ionl {
+
+struct GapBuffer;
+
+constexpr int64_t kDefaultUndoJournalByteLimit = 4 * 1024 * 1024;
+
+struct UndoEntry {
+    // Logical index where the edit happened
+    int64_t position;
+    // Text at [position, position + removed.size()) before the edit, replaced by `inserted`
+    std::vector<ImWchar> removed;
+    std::vector<ImWchar> inserted;
+    // Whether this entry is undone/redone together with the one before it, i.e. both were recorded between the same
+    // UndoJournal::BeginGroup() and EndGroup(). Each entry's position accounts for all entries before it in the group
+    // having been applied.
+    bool joinWithPrevious = false;
+
+    int64_t GetByteSize() const;
+};
+
+struct UndoJournal {
+    // Oldest entry first
+    std::deque<UndoEntry> undoEntries;
+    // Most recently undone entry last
+    std::vector<UndoEntry> redoEntries;
+
+    /// Oldest undo entries are dropped to keep `byteSize` below this
+    int64_t byteLimit;
+    int64_t byteSize = 0;
+
+    // Whether the next edit may be merged into the last entry
+    bool canCoalesce = false;
+    // Set while Undo()/Redo() are editing the buffer, so that they don't record themselves
+    bool isReplaying = false;
+    // Nesting depth of BeginGroup() calls
+    int groupDepth = 0;
+    // Whether the current group has an entry yet, which the next ones get joined to
+    bool hasGroupEntry = false;
+
+    explicit UndoJournal(int64_t byteLimit = kDefaultUndoJournalByteLimit);
+
+    bool CanUndo() const { return !undoEntries.empty(); }
+    bool CanRedo() const { return !redoEntries.empty(); }
+
+    /// Make the next edit start a new entry, e.g. when the cursor was moved by the user.
+    void BreakCoalescing() { canCoalesce = false; }
+    /// Make all edits recorded until the matching EndGroup() a single undo step, e.g. for a replace all. The step
+    /// doesn't absorb the typing before or after it. Groups may be nested, only the outermost one counts.
+    void BeginGroup();
+    void EndGroup();
+    void Clear();
+};
+
+/// Record that the text `removed` at logical index `position` got replaced by `inserted`. Either may be empty.
+/// Called by the GapBuffer editing functions, there is normally no need to call this directly.
+void RecordEdit(UndoJournal& journal, int64_t position, const ImWchar* removed, size_t removedSize, const ImWchar* inserted, size_t insertedSize);
+
+/// \return Logical index right after the restored text (where the cursor should be placed), or -1 if there is nothing
+///         to undo.
+int64_t Undo(UndoJournal& journal, GapBuffer& buf);
+/// \return Logical index right after the re-applied text, or -1 if there is nothing to redo.
+int64_t Redo(UndoJournal& journal, GapBuffer& buf);
+
+/// Show the journal's statistics using ImGui
+void ShowUndoJournal(const UndoJournal& journal);
+
+} // namespace Ionl
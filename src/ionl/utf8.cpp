@@ -0,0 +1,343 @@
+#include "utf8.hpp"
+
+#include <imgui/imgui_internal.h>
+
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    define IONL_UTF8_X86 1
+#    include <immintrin.h>
+#    if defined(_MSC_VER) && !defined(__clang__)
+#        include <intrin.h>
+#        define IONL_TARGET_AVX2
+#    else
+#        define IONL_TARGET_AVX2 __attribute__((target("avx2")))
+#    endif
+#else
+#    define IONL_UTF8_X86 0
+#endif
+
+using namespace Ionl;
+
+namespace {
+// The vector kernels below are only written for 16-bit ImWchar, which is what we use. If IMGUI_USE_WCHAR32 ever gets
+// turned on, everything goes through the scalar path.
+constexpr bool kWideKernelsUsable = sizeof(ImWchar) == 2;
+
+/* Scalar building blocks, also used as the tail/fallback of the vector kernels */
+
+// Returns false if decoding must stop (NUL or end of output reached)
+inline bool DecodeOne(ImWchar*& out, const char*& p, const char* end) {
+    if (*p == '\0') return false;
+    unsigned int c;
+    p += ImTextCharFromUtf8(&c, p, end);
+    if (c == 0) return false;
+    *out++ = (ImWchar)c;
+    return true;
+}
+
+inline int CountUtf8BytesFromChar(unsigned int c) {
+    if (c < 0x80) return 1;
+    if (c < 0x800) return 2;
+    if (c < 0x10000) return 3;
+    if (c <= 0x10FFFF) return 4;
+    return 3;
+}
+
+int64_t CountCodepointsScalar(const char* p, const char* end) {
+    int64_t count = 0;
+    while (p < end && *p) {
+        unsigned int c;
+        p += ImTextCharFromUtf8(&c, p, end);
+        count += 1;
+    }
+    return count;
+}
+
+int64_t DecodeScalar(ImWchar* out, int64_t outCapacity, const char* p, const char* end, const char** remaining) {
+    ImWchar* outBegin = out;
+    ImWchar* outEnd = out + outCapacity;
+    while (out < outEnd && p < end) {
+        if (!DecodeOne(out, p, end)) break;
+    }
+    if (remaining) *remaining = p;
+    return out - outBegin;
+}
+
+int64_t CountBytesScalar(const ImWchar* p, const ImWchar* end) {
+    int64_t count = 0;
+    for (; p < end && *p; ++p) {
+        count += CountUtf8BytesFromChar(*p);
+    }
+    return count;
+}
+
+int64_t EncodeScalar(char* out, const ImWchar* p, const ImWchar* end) {
+    char* outBegin = out;
+    for (; p < end && *p; ++p) {
+        unsigned int c = *p;
+        if (c < 0x80) {
+            *out++ = (char)c;
+        } else {
+            out += ImTextCharToUtf8Counted(out, c);
+        }
+    }
+    return out - outBegin;
+}
+
+#if IONL_UTF8_X86
+/* SSE2 kernels: always available on x86-64 */
+
+// Bitmask of bytes in `v` that are not plain (non-NUL) ASCII
+inline int NonAsciiMask128(__m128i v) {
+    return _mm_movemask_epi8(v) | _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128()));
+}
+
+int64_t CountCodepointsSse2(const char* p, const char* end) {
+    int64_t count = 0;
+    while (p < end) {
+        if (end - p >= 16) {
+            int mask = NonAsciiMask128(_mm_loadu_si128((const __m128i*)p));
+            if (mask == 0) {
+                p += 16;
+                count += 16;
+                continue;
+            }
+            int n = std::countr_zero((unsigned)mask);
+            p += n;
+            count += n;
+        }
+        if (*p == '\0') break;
+        unsigned int c;
+        p += ImTextCharFromUtf8(&c, p, end);
+        count += 1;
+    }
+    return count;
+}
+
+int64_t DecodeSse2(ImWchar* out, int64_t outCapacity, const char* p, const char* end, const char** remaining) {
+    ImWchar* outBegin = out;
+    ImWchar* outEnd = out + outCapacity;
+    const __m128i zero = _mm_setzero_si128();
+    while (out < outEnd && p < end) {
+        if (end - p >= 16 && outEnd - out >= 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)p);
+            // Widen all 16 lanes unconditionally, the ones past the first non-ASCII byte get overwritten later
+            _mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(v, zero));
+            _mm_storeu_si128((__m128i*)(out + 8), _mm_unpackhi_epi8(v, zero));
+
+            int mask = NonAsciiMask128(v);
+            int n = mask == 0 ? 16 : std::countr_zero((unsigned)mask);
+            p += n;
+            out += n;
+            if (n == 16) continue;
+        }
+        if (!DecodeOne(out, p, end)) break;
+    }
+    if (remaining) *remaining = p;
+    return out - outBegin;
+}
+
+int64_t CountBytesSse2(const ImWchar* p, const ImWchar* end) {
+    int64_t count = 0;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maskNot1Byte = _mm_set1_epi16((short)0xFF80);
+    const __m128i maskNot2Bytes = _mm_set1_epi16((short)0xF800);
+    while (end - p >= 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) != 0) {
+            // Contains NUL, let the scalar code figure out where to stop
+            break;
+        }
+        // Each ImWchar takes 1 byte, +1 if >= 0x80, +1 if >= 0x800 (16-bit ImWchar can never need 4 bytes)
+        int is1Byte = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, maskNot1Byte), zero));
+        int is2Bytes = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, maskNot2Bytes), zero));
+        // movemask gives 2 bits per 16-bit lane
+        count += 8 + (16 - std::popcount((unsigned)is1Byte)) / 2 + (16 - std::popcount((unsigned)is2Bytes)) / 2;
+        p += 8;
+    }
+    return count + CountBytesScalar(p, end);
+}
+
+int64_t EncodeSse2(char* out, const ImWchar* p, const ImWchar* end) {
+    char* outBegin = out;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i maskNot1Byte = _mm_set1_epi16((short)0xFF80);
+    while (end - p >= 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int nonAscii = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, maskNot1Byte), zero)) ^ 0xFFFF;
+        int nul = _mm_movemask_epi8(_mm_cmpeq_epi16(v, zero));
+        if ((nonAscii | nul) == 0) {
+            _mm_storel_epi64((__m128i*)out, _mm_packus_epi16(v, v));
+            out += 8;
+            p += 8;
+            continue;
+        }
+        // Mixed block, encode it one codepoint at a time
+        // (instead of resuming vector code right after the offending lane, which is a loss for mostly non-ASCII text)
+        for (const ImWchar* blockEnd = p + 8; p < blockEnd; ++p) {
+            if (*p == 0) return out - outBegin;
+            out += ImTextCharToUtf8Counted(out, *p);
+        }
+    }
+    return (out - outBegin) + EncodeScalar(out, p, end);
+}
+
+/* AVX2 kernels: selected at runtime */
+
+IONL_TARGET_AVX2 int NonAsciiMask256(__m256i v) {
+    return _mm256_movemask_epi8(v) | _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+}
+
+IONL_TARGET_AVX2 int64_t CountCodepointsAvx2(const char* p, const char* end) {
+    int64_t count = 0;
+    while (p < end) {
+        if (end - p >= 32) {
+            unsigned mask = (unsigned)NonAsciiMask256(_mm256_loadu_si256((const __m256i*)p));
+            if (mask == 0) {
+                p += 32;
+                count += 32;
+                continue;
+            }
+            int n = std::countr_zero(mask);
+            p += n;
+            count += n;
+        }
+        if (*p == '\0') break;
+        unsigned int c;
+        p += ImTextCharFromUtf8(&c, p, end);
+        count += 1;
+    }
+    return count;
+}
+
+IONL_TARGET_AVX2 int64_t DecodeAvx2(ImWchar* out, int64_t outCapacity, const char* p, const char* end, const char** remaining) {
+    ImWchar* outBegin = out;
+    ImWchar* outEnd = out + outCapacity;
+    while (out < outEnd && p < end) {
+        if (end - p >= 32 && outEnd - out >= 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)p);
+            _mm256_storeu_si256((__m256i*)out, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+            _mm256_storeu_si256((__m256i*)(out + 16), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+
+            unsigned mask = (unsigned)NonAsciiMask256(v);
+            int n = mask == 0 ? 32 : std::countr_zero(mask);
+            p += n;
+            out += n;
+            if (n == 32) continue;
+        }
+        if (!DecodeOne(out, p, end)) break;
+    }
+    if (remaining) *remaining = p;
+    return out - outBegin;
+}
+
+IONL_TARGET_AVX2 int64_t CountBytesAvx2(const ImWchar* p, const ImWchar* end) {
+    int64_t count = 0;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maskNot1Byte = _mm256_set1_epi16((short)0xFF80);
+    const __m256i maskNot2Bytes = _mm256_set1_epi16((short)0xF800);
+    while (end - p >= 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, zero)) != 0) {
+            break;
+        }
+        unsigned is1Byte = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, maskNot1Byte), zero));
+        unsigned is2Bytes = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, maskNot2Bytes), zero));
+        count += 16 + (32 - std::popcount(is1Byte)) / 2 + (32 - std::popcount(is2Bytes)) / 2;
+        p += 16;
+    }
+    return count + CountBytesSse2(p, end);
+}
+
+IONL_TARGET_AVX2 int64_t EncodeAvx2(char* out, const ImWchar* p, const ImWchar* end) {
+    char* outBegin = out;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i maskNot1Byte = _mm256_set1_epi16((short)0xFF80);
+    while (end - p >= 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned special =
+            ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi16(_mm256_and_si256(v, maskNot1Byte), zero)) |
+            (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi16(v, zero));
+        if (special == 0) {
+            // packus works within 128-bit lanes, so pack the two halves of the register against each other instead
+            __m128i lo = _mm256_castsi256_si128(v);
+            __m128i hi = _mm256_extracti128_si256(v, 1);
+            _mm_storeu_si128((__m128i*)out, _mm_packus_epi16(lo, hi));
+            out += 16;
+            p += 16;
+            continue;
+        }
+        for (const ImWchar* blockEnd = p + 16; p < blockEnd; ++p) {
+            if (*p == 0) return out - outBegin;
+            out += ImTextCharToUtf8Counted(out, *p);
+        }
+    }
+    return (out - outBegin) + EncodeSse2(out, p, end);
+}
+
+bool IsAvx2Supported() {
+#    if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    // Check the OS saves YMM registers on context switch
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#    else
+    return __builtin_cpu_supports("avx2");
+#    endif
+}
+#endif
+
+struct Utf8Kernels {
+    const char* name;
+    int64_t (*countCodepoints)(const char*, const char*);
+    int64_t (*decode)(ImWchar*, int64_t, const char*, const char*, const char**);
+    int64_t (*countBytes)(const ImWchar*, const ImWchar*);
+    int64_t (*encode)(char*, const ImWchar*, const ImWchar*);
+};
+
+Utf8Kernels SelectKernels() {
+#if IONL_UTF8_X86
+    if (kWideKernelsUsable) {
+        if (IsAvx2Supported()) {
+            return { "AVX2", &CountCodepointsAvx2, &DecodeAvx2, &CountBytesAvx2, &EncodeAvx2 };
+        }
+        return { "SSE2", &CountCodepointsSse2, &DecodeSse2, &CountBytesSse2, &EncodeSse2 };
+    }
+#endif
+    return { "Scalar", &CountCodepointsScalar, &DecodeScalar, &CountBytesScalar, &EncodeScalar };
+}
+
+const Utf8Kernels& GetKernels() {
+    static const Utf8Kernels kernels = SelectKernels();
+    return kernels;
+}
+} // namespace
+
+int64_t Ionl::Utf8CountCodepoints(const char* begin, const char* end) {
+    return GetKernels().countCodepoints(begin, end);
+}
+
+int64_t Ionl::Utf8Decode(ImWchar* out, int64_t outCapacity, const char* begin, const char* end, const char** remaining) {
+    return GetKernels().decode(out, outCapacity, begin, end, remaining);
+}
+
+int64_t Ionl::Utf8CountBytes(const ImWchar* begin, const ImWchar* end) {
+    return GetKernels().countBytes(begin, end);
+}
+
+int64_t Ionl::Utf8Encode(char* out, const ImWchar* begin, const ImWchar* end) {
+    return GetKernels().encode(out, begin, end);
+}
+
+const char* Ionl::GetUtf8KernelName() {
+    return GetKernels().name;
+}
@@ -0,0 +1,33 @@
+// Vectorized replacements for ImGui's UTF-8 <-> ImWchar conversion routines, used on the GapBuffer load/save paths.
+// All functions here follow the exact same decoding/encoding rules as their ImGui counterparts (including how invalid
+// UTF-8 is handled), so they can be swapped in without changing logical indices. The speedup comes from processing
+// runs of ASCII 16 or 32 bytes at a time; everything else falls back to ImGui's scalar code one codepoint at a time.
+//
+// The kernel set (scalar, SSE2, AVX2) is selected at runtime on first use.
+#pragma once
+
+#include <imgui/imgui.h>
+
+#include <cstdint>
+
+namespace Ionl {
+
+/// Equivalent to ImTextCountCharsFromUtf8()
+int64_t Utf8CountCodepoints(const char* begin, const char* end);
+
+/// Equivalent to ImTextStrFromUtf8NoNullTerminate()
+/// \return Number of ImWchar's written to `out`.
+int64_t Utf8Decode(ImWchar* out, int64_t outCapacity, const char* begin, const char* end, const char** remaining = nullptr);
+
+/// Equivalent to ImTextCountUtf8BytesFromStr()
+int64_t Utf8CountBytes(const ImWchar* begin, const ImWchar* end);
+
+/// Equivalent to ImTextStrToUtf8(), except that the output is not null terminated.
+/// `out` must have space for at least `Utf8CountBytes(begin, end)` bytes.
+/// \return Number of bytes written to `out`.
+int64_t Utf8Encode(char* out, const ImWchar* begin, const ImWchar* end);
+
+/// Name of the kernel set selected for this CPU, for diagnostics.
+const char* GetUtf8KernelName();
+
+} // namespace Ionl
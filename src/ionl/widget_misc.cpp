@@ -1,3 +1,48 @@
 #include "widget_misc.hpp"
 
 #include <imgui/imgui_internal.h>
+
+#include <limits>
+
+using namespace Ionl;
+
+namespace {
+float gRequestedFrameTimeout = std::numeric_limits<float>::infinity();
+} // namespace
+
+float ImGui::GetContentRegionAvailWidthAt(float offsetX) {
+    ImGuiWindow* window = GetCurrentWindow();
+    return GetContentRegionMaxAbs().x - (window->Pos.x + offsetX);
+}
+
+void Ionl::RequestFrameWithin(float seconds) {
+    gRequestedFrameTimeout = ImMin(gRequestedFrameTimeout, seconds);
+}
+
+float Ionl::TakeRequestedFrameTimeout() {
+    float timeout = gRequestedFrameTimeout;
+    gRequestedFrameTimeout = std::numeric_limits<float>::infinity();
+    return timeout;
+}
+
+double Ionl::CalcNextSaveTime(const MainLoopTimes& times) {
+    if (!times.hasUnflushedOps) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return ImMin(times.lastEditTime + kSaveAfterIdleSeconds, times.lastWriteTime + kSaveIntervalSeconds);
+}
+
+double Ionl::CalcNextCompactionTime(const MainLoopTimes& times) {
+    // NOTE: compaction doesn't need to run again until something gets edited
+    if (times.lastEditTime <= times.lastCompactionTime) {
+        return std::numeric_limits<double>::infinity();
+    }
+    return ImMax(times.lastEditTime + kCompactAfterIdleSeconds, times.lastCompactionTime + kCompactIntervalSeconds);
+}
+
+double Ionl::CalcFrameTimeout(double requestedTimeout, const MainLoopTimes& times) {
+    double timeout = requestedTimeout;
+    timeout = ImMin(timeout, CalcNextSaveTime(times) - times.currTime);
+    timeout = ImMin(timeout, CalcNextCompactionTime(times) - times.currTime);
+    return timeout;
+}
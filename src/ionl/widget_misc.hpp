@@ -6,8 +6,44 @@
 
 namespace ImGui {
 
+/// What GetContentRegionAvail().x will be once the cursor is `offsetX` right of the current window's left edge, e.g. to
+/// know how wide a widget will get before getting to it.
+float GetContentRegionAvailWidthAt(float offsetX);
+
 } // namespace ImGui
 
 namespace Ionl {
 
+/// The main loop sleeps until there is input. Call this while drawing a frame to have another one drawn within `seconds`
+/// regardless, e.g. for the next step of an animation.
+void RequestFrameWithin(float seconds);
+/// Seconds until the soonest frame requested since the last call, or infinity if there is none. Resets the requests.
+float TakeRequestedFrameTimeout();
+
+// Save strategy: flush the queued database ops after this long without edits, or at least this often
+constexpr double kSaveAfterIdleSeconds = 1.0;
+constexpr double kSaveIntervalSeconds = 10.0;
+// Compaction strategy: compact bullet gaps after this long without edits, at most this often
+constexpr double kCompactAfterIdleSeconds = 5.0;
+constexpr double kCompactIntervalSeconds = 30.0;
+
+struct MainLoopTimes {
+    double currTime;
+    // When something last got edited
+    double lastEditTime;
+    double lastWriteTime;
+    double lastCompactionTime;
+    bool hasUnflushedOps;
+};
+
+/// When the queued database ops are due to be flushed, or infinity if there are none.
+double CalcNextSaveTime(const MainLoopTimes& times);
+/// When bullet gaps are due to be compacted, or infinity if nothing got edited since the last compaction.
+double CalcNextCompactionTime(const MainLoopTimes& times);
+
+/// How long the main loop may sleep waiting for input: until the soonest of `requestedTimeout` (from
+/// TakeRequestedFrameTimeout()), CalcNextSaveTime() and CalcNextCompactionTime().
+/// \return Seconds, 0 or less to not wait at all, or infinity to wait for input indefinitely.
+double CalcFrameTimeout(double requestedTimeout, const MainLoopTimes& times);
+
 } // namespace Ionl
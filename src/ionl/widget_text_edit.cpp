@@ -1,13 +1,22 @@
 #include "widget_text_edit.hpp"
 
 #include <imgui/imgui_internal.h>
+#include <imgui/imgui_stdlib.h>
+#include <ionl/undo_journal.hpp>
+#include <ionl/utf8.hpp>
+#include <ionl/widget_misc.hpp>
+#include <ionl/worker_pool.hpp>
 
 #include <algorithm>
 #include <cassert>
+#include <cfloat>
 #include <cinttypes>
+#include <cmath>
 #include <format>
 #include <iostream>
+#include <latch>
 #include <memory>
+#include <mutex>
 #include <span>
 #include <sstream>
 #include <utility>
@@ -54,7 +63,7 @@ void ShowDebugTextRunContents(const TChar* source, const TextRun& tr) {
 
 template <typename TChar>
 void ShowDebugTextRun(const TChar* source, const TextRun& tr) {
-    ImGui::Text("Segment: [%zu,%zu); %s %c%c%c%c%c",
+    ImGui::Text("Segment: [%d,%d); %s %c%c%c%c%c",
         tr.begin,
         tr.end,
         TextStyleTypeToString(tr.style.type),
@@ -150,39 +159,42 @@ const char* StringifyCursorAffinity(CursorAffinity v) {
 }
 #endif
 
-ImVec2 CalcSubTextRunDim(const TextBuffer& tb, const TextRun& tr, int64_t idxBeg, int64_t idxEnd) {
-    auto& face = gMarkdownStylesheet.LookupFace(tr.style);
-    auto beg = &tb.gapBuffer.buffer[idxBeg];
-    auto end = &tb.gapBuffer.buffer[idxEnd];
-    return face.font->CalcTextSize(face.font->FontSize, std::numeric_limits<float>::max(), 0.0f, beg, end);
-}
-
-struct LayoutInput {
-    // [Required] Markdown styling.
-    const MarkdownStylesheet* styles;
-    // [Required] Source buffer which generated the TextRun's.
-    const GapBuffer* src;
-    // [Required]
-    std::span<const TextRun> textRuns;
-    // [Optional] Width to wrap lines at; set to 0.0f to ignore line width.
-    float viewportWidth = std::numeric_limits<float>::max();
-};
-
-struct LayoutOutput {
-    std::vector<GlyphRun> glyphRuns;
-    ImVec2 boundingBox;
-};
+} // namespace
 
-LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
+Ionl::LayoutOutput Ionl::LayMarkdownTextRuns(const LayoutInput& in) {
     LayoutOutput out;
+    LayMarkdownTextRuns(in, out);
+    return out;
+}
+
+void Ionl::LayMarkdownTextRuns(const LayoutInput& in, LayoutOutput& out) {
+    out.glyphRuns.clear();
+    out.glyphAdvances.clear();
+    out.boundingBox = ImVec2(0.0f, in.startY);
 
-    ImVec2 currPos{};
+    ImVec2 currPos(0.0f, in.startY);
     ImVec2 currLineDim{};
     bool isBeginningOfParagraph = true;
 
     const auto gapBegin = in.src->GetGapBegin();
     const auto gapEnd = in.src->GetGapEnd();
 
+    // Every TextRun makes at least one GlyphRun, and every glyph gets an advance
+    out.glyphRuns.reserve(in.textRuns.size());
+    size_t numGlyphs = 0;
+    for (const auto& textRun : in.textRuns) {
+        numGlyphs += textRun.end - textRun.begin;
+    }
+    out.glyphAdvances.reserve(numGlyphs);
+
+    auto wrapLine = [&]() {
+        currPos.x = 0;
+        currPos.y += currLineDim.y + in.styles->linePadding;
+        out.boundingBox.x = ImMax(out.boundingBox.x, currLineDim.x);
+        out.boundingBox.y += currLineDim.y + in.styles->linePadding;
+        currLineDim = {};
+    };
+
     for (const auto& textRun : in.textRuns) {
         auto& face = in.styles->LookupFace(textRun.style);
 
@@ -202,6 +214,12 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
             // TODO don't strip whitespace at end of line, we need it to be inside a GlyphRun for cursor position code to function correctly
             auto runDim = face.font->CalcTextLineSize(face.font->FontSize, in.viewportWidth - currLineDim.x, in.viewportWidth - currLineDim.x, beg, end, &remaining);
             // `beg` acts as the `remaining` from the last iteration (and for the first iteration, if nothing is placed hence `remaining == beg`, we should bail out too)
+            if (remaining == beg && currLineDim.x > 0.0f) {
+                // Not even the first word of this TextRun fits in what's left of the current line, which a previous
+                // TextRun partially filled. Retry on a new line, the GlyphRun will then be soft wrapped as it should.
+                wrapLine();
+                continue;
+            }
             if (remaining == beg) {
                 // The inner algorithm is deadlocked, bail out
                 std::stringstream ss;
@@ -209,14 +227,17 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
                 PrintDebugTextRun(ss, std::string_view(), textRun);
 #endif
                 std::string_view v = ss.rdbuf()->view();
+                // Layout may run on worker threads, see LayTextEditsInParallel()
+                static std::mutex debugLogMutex;
+                std::lock_guard lock(debugLogMutex);
                 ImGui::DebugLog("LayMarkdownTextRuns(): bailing out because text cannot be laid in the given space for TextRun %.*s", (int)v.size(), v.data());
                 break;
             }
 
             GlyphRun glyphRun;
             glyphRun.tr = textRun;
-            glyphRun.tr.begin = std::distance(in.src->PtrBegin(), beg);
-            glyphRun.tr.end = std::distance(in.src->PtrBegin(), remaining);
+            glyphRun.tr.begin = (int32_t)std::distance(in.src->PtrBegin(), beg);
+            glyphRun.tr.end = (int32_t)std::distance(in.src->PtrBegin(), remaining);
             // If a TextRun emits multiple GlyphRun's, only the last one should have this property set -- we do it after this loop [1]
             glyphRun.tr.hasParagraphBreak = false;
             // Similarly this should be set for everyone but the last GlyphRun
@@ -224,8 +245,17 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
             glyphRun.pos = currPos;
             glyphRun.horizontalAdvance = runDim.x;
             glyphRun.height = runDim.y;
+            glyphRun.advancesBegin = (int32_t)out.glyphAdvances.size();
             out.glyphRuns.push_back(std::move(glyphRun));
 
+            // Measured the same way as CalcTextLineSize() above, except that blanks skipped at a soft wrap are counted
+            // too, so that the cursor can be placed on them
+            float x = 0.0f;
+            for (auto p = beg; p != remaining; ++p) {
+                x += face.font->GetCharAdvance(*p);
+                out.glyphAdvances.push_back(x);
+            }
+
             currPos.x += runDim.x;
             currLineDim.x += runDim.x;
             currLineDim.y = ImMax(currLineDim.y, runDim.y);
@@ -239,11 +269,7 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
             beg = remaining;
 
             // Wrap onto next line
-            currPos.x = 0;
-            currPos.y += currLineDim.y + in.styles->linePadding;
-            out.boundingBox.x = ImMax(out.boundingBox.x, currLineDim.x);
-            out.boundingBox.y += currLineDim.y + in.styles->linePadding;
-            currLineDim = {};
+            wrapLine();
         }
 
         // Set last GlyphRun's property, see above [1]
@@ -266,30 +292,171 @@ LayoutOutput LayMarkdownTextRuns(const LayoutInput& in) {
         // Add last line's height (where the wrapping code is not reached)
         out.boundingBox.y += currLineDim.y;
     }
+}
 
-    return out;
+bool Ionl::RelayMarkdownTextRuns(const MarkdownStylesheet& styles, const TextBuffer& tb, float viewportWidth, std::vector<GlyphRun>& glyphRuns, std::vector<float>& glyphAdvances, float& contentHeight, LayoutOutput& scratch) {
+    auto& buf = tb.gapBuffer;
+    auto& change = tb.lastChange;
+    if (change.prevGapBegin == -1) {
+        return false;
+    }
+
+    // Paragraphs are laid out independently of each other: each one starts at x = 0, right below the previous one. So
+    // everything outside of the region to lay out again only needs to be moved, and the region must contain whole
+    // paragraphs.
+    // Layout also splits words at the gap (via the TextRun's), so the paragraphs containing the old and the new gap must
+    // be included too, even if their text didn't change.
+    int64_t begin = std::numeric_limits<int64_t>::max();
+    int64_t end = std::numeric_limits<int64_t>::min();
+    if (change.begin <= change.end) {
+        begin = change.begin;
+        end = change.end;
+    }
+    auto includeParagraphContaining = [&](int64_t logicalIdx) {
+        int64_t paragraph = FindParagraphContaining(buf, logicalIdx);
+        begin = std::min(begin, GetParagraphBegin(buf, paragraph));
+        end = std::max(end, GetParagraphEnd(buf, paragraph));
+    };
+    // Old gap, converted into current logical indices. If it was inside the reparsed range, that's already included.
+    int64_t prevGapBegin = change.prevGapBegin;
+    if (prevGapBegin < begin) {
+        includeParagraphContaining(prevGapBegin);
+    } else if (prevGapBegin > end - change.delta) {
+        includeParagraphContaining(prevGapBegin + change.delta);
+    }
+    includeParagraphContaining(buf.GetGapBegin());
+    // End of the region in the previous version's logical indices
+    int64_t prevEnd = end - change.delta;
+
+    // GlyphRun's of the previous version, which are in indices of the previous buffer
+    auto prevLogicalBegin = [&](const GlyphRun& glyphRun) -> int64_t {
+        int64_t b = glyphRun.tr.begin;
+        return b < change.prevGapBegin ? b : b - change.prevGapSize;
+    };
+    auto lo = std::partition_point(glyphRuns.begin(), glyphRuns.end(), [&](const GlyphRun& gr) { return prevLogicalBegin(gr) < begin; });
+    auto hi = std::partition_point(lo, glyphRuns.end(), [&](const GlyphRun& gr) { return prevLogicalBegin(gr) <= prevEnd; });
+
+    int64_t gapBegin = buf.GetGapBegin();
+    int64_t gapSize = buf.GetGapSize();
+    auto logicalBegin = [&](const TextRun& textRun) -> int64_t {
+        int64_t b = textRun.begin;
+        return b < gapBegin ? b : b - gapSize;
+    };
+    auto runsLo = std::partition_point(tb.textRuns.begin(), tb.textRuns.end(), [&](const TextRun& tr) { return logicalBegin(tr) < begin; });
+    auto runsHi = std::partition_point(runsLo, tb.textRuns.end(), [&](const TextRun& tr) { return logicalBegin(tr) <= end; });
+
+    // Where the paragraph beginning at `it` was laid out; empty paragraphs generate nothing and take up no space
+    auto paragraphY = [&](std::vector<GlyphRun>::iterator it) {
+        return it == glyphRuns.end() ? contentHeight : it->pos.y;
+    };
+    float startY = paragraphY(lo);
+    float prevNextY = paragraphY(hi);
+
+    LayMarkdownTextRuns(
+        {
+            .styles = &styles,
+            .src = &buf,
+            .textRuns = std::span(runsLo, runsHi),
+            .viewportWidth = viewportWidth,
+            .startY = startY,
+        },
+        scratch);
+    // After a paragraph break, layout continues at the beginning of the next paragraph, which is where the rest goes
+    float dy = scratch.boundingBox.y - prevNextY;
+
+    // Everything after the region is after both gaps
+    auto shift = (int32_t)(change.delta + gapSize - change.prevGapSize);
+    for (auto it = hi; it != glyphRuns.end(); ++it) {
+        it->tr.begin += shift;
+        it->tr.end += shift;
+        it->pos.y += dy;
+    }
+
+    // Splicing the advances in place would move everything after the region, which is a lot more data than the
+    // GlyphRun's. Instead, append the new ones and leave the old ones unreferenced, until those make up most of the array.
+    auto& relaid = scratch.glyphRuns;
+    auto advancesBegin = (int32_t)glyphAdvances.size();
+    glyphAdvances.insert(glyphAdvances.end(), scratch.glyphAdvances.begin(), scratch.glyphAdvances.end());
+    for (auto& glyphRun : relaid) {
+        glyphRun.advancesBegin += advancesBegin;
+    }
+    auto numReplaced = std::min<size_t>(hi - lo, relaid.size());
+    auto it = std::copy_n(relaid.begin(), numReplaced, lo);
+    if (it != hi) {
+        glyphRuns.erase(it, hi);
+    } else {
+        glyphRuns.insert(it, relaid.begin() + numReplaced, relaid.end());
+    }
+
+    contentHeight += dy;
+
+    // There is at most one advance per character, so past this more than half of them are unreferenced
+    if ((int64_t)glyphAdvances.size() > 2 * buf.GetContentSize() + 1024) {
+        auto& compacted = scratch.glyphAdvances;
+        compacted.clear();
+        for (auto& glyphRun : glyphRuns) {
+            auto first = glyphAdvances.begin() + glyphRun.advancesBegin;
+            glyphRun.advancesBegin = (int32_t)compacted.size();
+            compacted.insert(compacted.end(), first, first + (glyphRun.tr.end - glyphRun.tr.begin));
+        }
+        glyphAdvances.swap(compacted);
+    }
+
+    return true;
+}
+
+float Ionl::CalcGlyphRunOffsetX(std::span<const float> glyphAdvances, const GlyphRun& glyphRun, int64_t bufferIdx) {
+    int64_t numGlyphs = ImClamp<int64_t>(bufferIdx, glyphRun.tr.begin, glyphRun.tr.end) - glyphRun.tr.begin;
+    return numGlyphs == 0 ? 0.0f : glyphAdvances[glyphRun.advancesBegin + numGlyphs - 1];
+}
+
+int64_t Ionl::FindGlyphRunIndexAtX(std::span<const float> glyphAdvances, const GlyphRun& glyphRun, float x) {
+    auto advances = glyphAdvances.subspan(glyphRun.advancesBegin, glyphRun.tr.end - glyphRun.tr.begin);
+    // We consider `x` to land between two characters 'ab' if it's between the halfway point of both glyphs (if it's
+    // inside the latter half of 'a', it lands before 'b')
+    auto it = std::partition_point(advances.begin(), advances.end(), [&](const float& right) {
+        float left = &right == advances.data() ? 0.0f : (&right)[-1];
+        return x >= (left + right) / 2;
+    });
+    return glyphRun.tr.begin + (it - advances.begin());
+}
+
+namespace {
+// TextEdit's are grouped into jobs of about this much content (in characters) for LayTextEditsInParallel(), so that
+// scheduling overhead doesn't dominate for the typical bullet, which is tiny
+constexpr int64_t kLayoutJobContentSize = 16 * 1024;
+
+bool IsTextEditCachedDataCurrent(const TextEdit& te, float viewportWidth) {
+    return te._cachedDataVersion == te._tb->cacheDataVersion &&
+           te._cachedViewportWidth == viewportWidth;
 }
 
 void RefreshCursorState(TextEdit& te);
 void RefreshTextEditCachedData(TextEdit& te, float viewportWidth) {
     TextBuffer& tb = *te._tb;
 
-    if (te._cachedDataVersion == tb.cacheDataVersion &&
-        te._cachedViewportWidth == viewportWidth) {
+    if (IsTextEditCachedDataCurrent(te, viewportWidth)) {
         return;
     }
     // There must be a bug if we somehow have a newer version in the TextEdit (downstream) than its corresponding TextBuffer (upstream)
     assert(te._cachedDataVersion <= tb.cacheDataVersion);
 
-    auto res = LayMarkdownTextRuns({
-        .styles = &gMarkdownStylesheet,
-        .src = &tb.gapBuffer,
-        .textRuns = std::span(tb.textRuns),
-        .viewportWidth = viewportWidth,
-    });
-
-    te._cachedGlyphRuns = std::move(res.glyphRuns);
-    te._cachedContentHeight = res.boundingBox.y;
+    // Typically the TextBuffer got refreshed once since last frame, after an edit or cursor movement
+    bool relaid = te._cachedViewportWidth == viewportWidth &&
+                  te._cachedDataVersion + 1 == tb.cacheDataVersion &&
+                  RelayMarkdownTextRuns(gMarkdownStylesheet, tb, viewportWidth, te._cachedGlyphRuns, te._cachedGlyphAdvances, te._cachedContentHeight, te._relayoutScratch);
+    if (!relaid) {
+        auto res = LayMarkdownTextRuns({
+            .styles = &gMarkdownStylesheet,
+            .src = &tb.gapBuffer,
+            .textRuns = std::span(tb.textRuns),
+            .viewportWidth = viewportWidth,
+        });
+
+        te._cachedGlyphRuns = std::move(res.glyphRuns);
+        te._cachedGlyphAdvances = std::move(res.glyphAdvances);
+        te._cachedContentHeight = res.boundingBox.y;
+    }
     te._cachedDataVersion = tb.cacheDataVersion;
     te._cachedViewportWidth = viewportWidth;
 
@@ -297,6 +464,12 @@ void RefreshTextEditCachedData(TextEdit& te, float viewportWidth) {
     te._cursorAnimTimer = 0.0f;
 }
 
+void RefreshTextEditsCachedData(std::span<const TextEditLayoutRequest> requests) {
+    for (auto& req : requests) {
+        RefreshTextEditCachedData(*req.textEdit, req.viewportWidth);
+    }
+}
+
 bool IsCharAPartOfWord(ImWchar c) {
     return !std::isspace(c);
 }
@@ -389,6 +562,115 @@ size_t FindGlyphRunContainingIndex(std::span<const GlyphRun> glyphRuns, size_t s
     return -1;
 }
 
+// Range [first, last) of GlyphRun's on the lines overlapping [minY, maxY), in text canvas space. GlyphRun's are sorted by
+// y, and the ones on the same line share the same y.
+std::pair<size_t, size_t> FindGlyphRunsBetweenY(std::span<const GlyphRun> glyphRuns, float minY, float maxY) {
+    auto lo = std::partition_point(glyphRuns.begin(), glyphRuns.end(), [&](const GlyphRun& gr) { return gr.pos.y <= minY; });
+    // Of the lines beginning above `minY`, only the last one can reach into the range
+    if (lo != glyphRuns.begin()) {
+        float lineY = std::prev(lo)->pos.y;
+        while (lo != glyphRuns.begin() && std::prev(lo)->pos.y == lineY) {
+            --lo;
+        }
+    }
+    auto hi = std::partition_point(lo, glyphRuns.end(), [&](const GlyphRun& gr) { return gr.pos.y < maxY; });
+    return { lo - glyphRuns.begin(), hi - glyphRuns.begin() };
+}
+
+void DrawGlyphRun(ImDrawList* drawList, ImVec2 origin, const GapBuffer& buf, const GlyphRun& glyphRun, ImU32 styleTextColor) {
+    auto& face = gMarkdownStylesheet.LookupFace(glyphRun.tr.style);
+
+    auto absPos = origin + glyphRun.pos;
+    auto font = face.font;
+    auto color = face.color == 0 ? styleTextColor : face.color;
+    drawList->AddText(font, font->FontSize, absPos, color, &buf.buffer[glyphRun.tr.begin], &buf.buffer[glyphRun.tr.end]);
+
+    if (glyphRun.tr.style.isUnderline) {
+        float y = absPos.y + font->FontSize;
+        drawList->AddLine(ImVec2(absPos.x, y), ImVec2(absPos.x + glyphRun.horizontalAdvance, y), color);
+    }
+    if (glyphRun.tr.style.isStrikethrough) {
+        float y = absPos.y + font->FontSize / 2;
+        drawList->AddLine(ImVec2(absPos.x, y), ImVec2(absPos.x + glyphRun.horizontalAdvance, y), color);
+    }
+}
+
+// Tessellate the GlyphRun's [first, last) into `cache`, exactly as DrawGlyphRun() would draw them into `drawList`, at
+// the fractional part of the draw origin.
+void FillGlyphRunDrawCache(GlyphRunDrawCache& cache, const ImDrawList& drawList, const GapBuffer& buf, std::span<const GlyphRun> glyphRuns, size_t first, size_t last) {
+    cache.firstRun = first;
+    cache.lastRun = last;
+    cache.vertices.clear();
+    cache.indices.clear();
+    cache.runVertexBegin.clear();
+    cache.runIndexBegin.clear();
+
+    ImVec2 origin(cache.key.originFracX, cache.key.originFracY);
+    ImDrawList scratch(drawList._Data);
+    for (size_t i = first; i < last; ++i) {
+        cache.runVertexBegin.push_back((int32_t)cache.vertices.size());
+        cache.runIndexBegin.push_back((int32_t)cache.indices.size());
+
+        // A fresh draw list for each GlyphRun, so that its indices begin at 0
+        scratch._ResetForNewFrame();
+        scratch.Flags = drawList.Flags;
+        // Keep everything, culling happens when replaying
+        scratch.PushClipRect(ImVec2(-FLT_MAX, -FLT_MAX), ImVec2(FLT_MAX, FLT_MAX));
+        scratch.PushTextureID(drawList._CmdHeader.TextureId);
+        DrawGlyphRun(&scratch, origin, buf, glyphRuns[i], cache.key.textColor);
+
+        cache.vertices.insert(cache.vertices.end(), scratch.VtxBuffer.begin(), scratch.VtxBuffer.end());
+        cache.indices.insert(cache.indices.end(), scratch.IdxBuffer.begin(), scratch.IdxBuffer.end());
+    }
+    cache.runVertexBegin.push_back((int32_t)cache.vertices.size());
+    cache.runIndexBegin.push_back((int32_t)cache.indices.size());
+}
+
+// Copy the cached GlyphRun's [first, last) into `drawList`, moved by `offset`
+void ReplayGlyphRunDrawCache(const GlyphRunDrawCache& cache, ImDrawList* drawList, ImVec2 offset, size_t first, size_t last) {
+    assert(first >= cache.firstRun && last <= cache.lastRun);
+    auto vertexBegin = [&](size_t run) { return cache.runVertexBegin[run - cache.firstRun]; };
+    auto indexBegin = [&](size_t run) { return cache.runIndexBegin[run - cache.firstRun]; };
+
+    // With 16-bit indices, a single reservation can only address 64K vertices
+    constexpr int32_t kMaxChunkVertices = sizeof(ImDrawIdx) == 2 ? 0xFFFF : std::numeric_limits<int32_t>::max();
+
+    size_t chunkBegin = first;
+    while (chunkBegin < last) {
+        size_t chunkEnd = chunkBegin + 1;
+        while (chunkEnd < last && vertexBegin(chunkEnd + 1) - vertexBegin(chunkBegin) <= kMaxChunkVertices) {
+            ++chunkEnd;
+        }
+
+        int32_t firstVertex = vertexBegin(chunkBegin);
+        int32_t numVertices = vertexBegin(chunkEnd) - firstVertex;
+        int32_t numIndices = indexBegin(chunkEnd) - indexBegin(chunkBegin);
+        if (numVertices > 0) {
+            drawList->PrimReserve(numIndices, numVertices);
+
+            auto vtxWrite = drawList->_VtxWritePtr;
+            for (int32_t i = 0; i < numVertices; ++i) {
+                vtxWrite[i] = cache.vertices[firstVertex + i];
+                vtxWrite[i].pos += offset;
+            }
+
+            auto idxWrite = drawList->_IdxWritePtr;
+            for (size_t run = chunkBegin; run < chunkEnd; ++run) {
+                auto base = (ImDrawIdx)(drawList->_VtxCurrentIdx + (vertexBegin(run) - firstVertex));
+                for (int32_t i = indexBegin(run); i < indexBegin(run + 1); ++i) {
+                    *idxWrite++ = (ImDrawIdx)(base + cache.indices[i]);
+                }
+            }
+
+            drawList->_VtxWritePtr += numVertices;
+            drawList->_IdxWritePtr += numIndices;
+            drawList->_VtxCurrentIdx += numVertices;
+        }
+
+        chunkBegin = chunkEnd;
+    }
+}
+
 void RefreshCursorState(TextEdit& te) {
     auto cursorBufIdx = MapLogicalIndexToBufferIndex(te._tb->gapBuffer, te._cursorIdx);
     te._cursorCurrGlyphRun = FindGlyphRunContainingIndex(te._cachedGlyphRuns, te._cursorCurrGlyphRun, cursorBufIdx);
@@ -407,7 +689,7 @@ void RefreshCursorState(TextEdit& te) {
     } else {
         visualGr = cursorGr;
         // Calculate width of text between start of GlyphRun to cursor
-        xOff = CalcSubTextRunDim(*te._tb, visualGr->tr, visualGr->tr.begin, cursorBufIdx).x;
+        xOff = CalcGlyphRunOffsetX(te._cachedGlyphAdvances, *visualGr, cursorBufIdx);
     }
     te._cursorVisualHeight = visualGr->height;
     te._cursorVisualOffset.x = visualGr->pos.x + xOff;
@@ -416,35 +698,36 @@ void RefreshCursorState(TextEdit& te) {
 
 // mouseX and mouseY should center on draw origin
 std::pair<int64_t, CursorAffinity> CalcCursorStateFromMouse(const TextEdit& te, float mouseX, float mouseY) {
-    auto it = te._cachedGlyphRuns.begin();
-
-    // Advance to the desired line by searching vertically
-    while (it != te._cachedGlyphRuns.end()) {
-        if (it->pos.y + it->height >= mouseY) {
-            break;
+    auto& glyphRuns = te._cachedGlyphRuns;
+
+    // Find the desired line by searching vertically: the last one beginning above the mouse, unless the mouse is in the
+    // padding below it. GlyphRun's on the same line share the same y.
+    auto it = std::partition_point(glyphRuns.begin(), glyphRuns.end(), [&](const GlyphRun& gr) { return gr.pos.y <= mouseY; });
+    if (it != glyphRuns.begin()) {
+        auto lineEnd = it;
+        float lineY = std::prev(it)->pos.y;
+        float lineBottom = lineY;
+        while (it != glyphRuns.begin() && std::prev(it)->pos.y == lineY) {
+            --it;
+            lineBottom = ImMax(lineBottom, it->pos.y + it->height);
+        }
+        if (lineBottom < mouseY) {
+            it = lineEnd;
         }
-        ++it;
     }
 
     auto lineBegin = it;
-    while (it != te._cachedGlyphRuns.end()) {
-        auto& face = gMarkdownStylesheet.LookupFace(it->tr.style);
-        float x = it->pos.x;
-        for (int64_t i = it->tr.begin; i < it->tr.end; ++i) {
-            ImWchar ch = te._tb->gapBuffer.buffer[i];
-            float w = face.font->GetCharAdvance(ch);
-            // We consider the cursor to land between two characters 'ab' if it's between the halfway point of both glyphs
-            // (if the cursor is inside the latter half of 'a', it will be caught by the iteration of 'b')
-            if (mouseX < (x + w / 2)) {
-                return { i, CursorAffinity::Irrelevant };
-            }
-            x += w;
-        }
-
+    while (it != glyphRuns.end()) {
         // Reached end of line, declare cursor to be on the last char
         if (it->isSoftWrapped && it != lineBegin) {
             return { it->tr.begin, CursorAffinity::Upstream };
         }
+
+        int64_t i = FindGlyphRunIndexAtX(te._cachedGlyphAdvances, *it, mouseX - it->pos.x);
+        if (i != it->tr.end) {
+            return { i, CursorAffinity::Irrelevant };
+        }
+
         if (it->tr.hasParagraphBreak) {
             // On \n
             return { it->tr.end, CursorAffinity::Irrelevant };
@@ -478,9 +761,21 @@ void MoveGapToCursor(TextEdit& te) {
     MoveGapToLogicalIndex(te._tb->gapBuffer, te._cursorIdx);
 }
 
+void ReplaceSelection(TextEdit& te, const ImWchar* text, size_t size) {
+    GapBufferEdit edit{
+        .begin = te.GetSelectionBegin(),
+        .end = te.GetSelectionEnd(),
+        .text = text,
+        .textSize = size,
+    };
+    ApplyEdits(te._tb->gapBuffer, std::span(&edit, 1));
+    te._cursorIdx = edit.begin + (int64_t)size;
+    te._anchorIdx = te._cursorIdx;
+}
+
 void InsertAtCursor(TextEdit& te, const ImWchar* text, size_t size) {
     if (te.HasSelection()) {
-        // TODO handle replacement of selection
+        ReplaceSelection(te, text, size);
     } else {
         MoveGapToCursor(te);
         InsertAtGap(te._tb->gapBuffer, text, size);
@@ -491,7 +786,7 @@ void InsertAtCursor(TextEdit& te, const ImWchar* text, size_t size) {
 
 void DeleteAtCursor(TextEdit& te, int64_t offset) {
     if (te.HasSelection()) {
-        // TODO
+        ReplaceSelection(te, nullptr, 0);
     } else {
         MoveGapToCursor(te);
         DeleteFromGap(te._tb->gapBuffer, offset);
@@ -500,6 +795,25 @@ void DeleteAtCursor(TextEdit& te, int64_t offset) {
     }
 }
 
+// Called when the user moves the cursor, so that typing from there on becomes a separate undo step
+void BreakUndoCoalescing(TextEdit& te) {
+    if (auto journal = te._tb->gapBuffer.undoJournal.get()) {
+        journal->BreakCoalescing();
+    }
+}
+
+void ApplyUndoJournal(TextEdit& te, bool undoOrRedo) {
+    auto journal = te._tb->gapBuffer.undoJournal.get();
+    if (!journal) return;
+
+    int64_t cursor = undoOrRedo ? Undo(*journal, te._tb->gapBuffer) : Redo(*journal, te._tb->gapBuffer);
+    if (cursor == -1) return;
+
+    te._cursorIdx = cursor;
+    te._anchorIdx = cursor;
+    te._tb->RefreshCaches();
+}
+
 void DeleteAtCursor(TextEdit& te, bool isMovingWord, bool backspaceOrDelete) {
     if (isMovingWord) {
         // TODO
@@ -621,6 +935,7 @@ void Ionl::TextEdit::Show() {
                 _cursorAffinity = flowAffinity;
             }
 
+            BreakUndoCoalescing(*this);
             RefreshCursorState(*this);
             _cursorAnimTimer = 0.0f;
         } else if (keyHome || keyEnd) {
@@ -638,12 +953,25 @@ void Ionl::TextEdit::Show() {
                 }
             } else {
                 // Move to beginning or end of line
+                // A line never extends past its paragraph, whose bounds we get from the newline index. Soft wraps
+                // inside the paragraph are found from the GlyphRuns.
+                auto& buf = _tb->gapBuffer;
+                int64_t paragraph = FindParagraphContaining(buf, _cursorIdx);
                 size_t starting = _cursorIsAtWrapPoint && _cursorAffinity == CursorAffinity::Upstream
                     ? _cursorCurrGlyphRun - 1
                     : _cursorCurrGlyphRun;
-                auto [prevWrapPt, idx] = FindLineWrapBeforeIndex(_cachedGlyphRuns, starting);
+                // TextRuns are split at the gap, so the wrap point might be a run end that sits right at gap begin
+                auto toLogicalIndex = [&](int64_t bufferIdx) {
+                    return bufferIdx == buf.GetGapBegin() ? buf.GetFrontSize() : MapBufferIndexToLogicalIndex(buf, bufferIdx);
+                };
+                if (keyHome) {
+                    auto [prevWrapPt, idx] = FindLineWrapBeforeIndex(_cachedGlyphRuns, starting);
+                    _cursorIdx = ImMax(toLogicalIndex(idx), GetParagraphBegin(buf, paragraph));
+                } else {
+                    auto [nextWrapPt, idx] = FindLineWrapAfterIndex(_cachedGlyphRuns, starting);
+                    _cursorIdx = ImMin(toLogicalIndex(idx), GetParagraphEnd(buf, paragraph));
+                }
 
-                _cursorIdx = MapBufferIndexToLogicalIndex(_tb->gapBuffer, idx);
                 if (!io.KeyShift)
                     _anchorIdx = _cursorIdx;
 
@@ -651,6 +979,7 @@ void Ionl::TextEdit::Show() {
                 _cursorAffinity = keyHome ? CursorAffinity::Downstream : CursorAffinity::Upstream;
             }
 
+            BreakUndoCoalescing(*this);
             RefreshCursorState(*this);
             _cursorAnimTimer = 0.0f;
         }
@@ -690,11 +1019,13 @@ void Ionl::TextEdit::Show() {
         } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_Z))
         {
             // Undo
-            // TODO
+            ApplyUndoJournal(*this, true);
+            _cursorAnimTimer = 0.0f;
         } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_Y))
         {
             // Redo
-            // TODO
+            ApplyUndoJournal(*this, false);
+            _cursorAnimTimer = 0.0f;
         } else if (isShortcutKey && ImGui::IsKeyPressed(ImGuiKey_A))
         {
             // Select all
@@ -710,6 +1041,7 @@ void Ionl::TextEdit::Show() {
             _cursorIdx = MapBufferIndexToLogicalIndex(_tb->gapBuffer, idx);
             if (!io.KeyShift) _anchorIdx = _cursorIdx;
             _cursorAffinity = affinity;
+            BreakUndoCoalescing(*this);
             RefreshCursorState(*this);
             _cursorAnimTimer = 0.0f;
         }
@@ -738,6 +1070,11 @@ void Ionl::TextEdit::Show() {
     auto styleTextColor = ImGui::GetColorU32(ImGuiCol_Text);
     auto styleSelectionColor = ImGui::GetColorU32(ImGuiCol_TextSelectedBg);
 
+    // Only draw the lines inside the clip rect, which for a long bullet is usually a small part of it
+    float clipMinY = drawList->GetClipRectMin().y - bb.Min.y;
+    float clipMaxY = drawList->GetClipRectMax().y - bb.Min.y;
+    auto [visibleBegin, visibleEnd] = FindGlyphRunsBetweenY(_cachedGlyphRuns, clipMinY, clipMaxY);
+
     // Draw selection if one exists
     if (activeId == _id && _cursorIdx != _anchorIdx) {
         // TODO possible optimization: start searching for selection end GlyphRun at whichever location is closer, _cursorCurrGlyphRun or end of document
@@ -751,9 +1088,9 @@ void Ionl::TextEdit::Show() {
             if (selBeginGrIdx == selEndGrIdx) {
                 auto& gr = _cachedGlyphRuns[selBeginGrIdx];
                 auto pMin = bb.Min + gr.pos;
-                pMin.x += CalcSubTextRunDim(*_tb, gr.tr, gr.tr.begin, selBegin).x;
+                pMin.x += CalcGlyphRunOffsetX(_cachedGlyphAdvances, gr, selBegin);
                 auto pMax = bb.Min + gr.pos;
-                pMax.x += gr.horizontalAdvance - CalcSubTextRunDim(*_tb, gr.tr, selEnd, gr.tr.end).x;
+                pMax.x += gr.horizontalAdvance - (CalcGlyphRunOffsetX(_cachedGlyphAdvances, gr, gr.tr.end) - CalcGlyphRunOffsetX(_cachedGlyphAdvances, gr, selEnd));
                 pMax.y += gr.height;
                 drawList->AddRectFilled(pMin, pMax, styleSelectionColor);
             } else {
@@ -762,12 +1099,14 @@ void Ionl::TextEdit::Show() {
                 // Draw selection for first GlyphRun
                 auto& selBeginGr = _cachedGlyphRuns[selBeginGrIdx];
                 pMin = bb.Min + selBeginGr.pos;
-                pMin.x += CalcSubTextRunDim(*_tb, selBeginGr.tr, selBeginGr.tr.begin, selBegin).x;
+                pMin.x += CalcGlyphRunOffsetX(_cachedGlyphAdvances, selBeginGr, selBegin);
                 pMax = bb.Min + selBeginGr.pos + ImVec2(selBeginGr.horizontalAdvance, selBeginGr.height);
                 drawList->AddRectFilled(pMin, pMax, styleSelectionColor);
 
                 // Draw in between `selBeginGrIdx` and `selEndGrIdx`
-                for (int64_t grIdx = selBeginGrIdx + 1; grIdx < selEndGrIdx; ++grIdx) {
+                auto first = std::max<size_t>(selBeginGrIdx + 1, visibleBegin);
+                auto last = std::min<size_t>(selEndGrIdx, visibleEnd);
+                for (size_t grIdx = first; grIdx < last; ++grIdx) {
                     auto& gr = _cachedGlyphRuns[grIdx];
                     drawList->AddRectFilled(
                         bb.Min + gr.pos,
@@ -779,7 +1118,7 @@ void Ionl::TextEdit::Show() {
                 auto& selEndGr = _cachedGlyphRuns[selEndGrIdx];
                 pMin = bb.Min + selEndGr.pos;
                 pMax = bb.Min + selEndGr.pos;
-                pMax.x += CalcSubTextRunDim(*_tb, selEndGr.tr, selEndGr.tr.begin, selEnd).x;
+                pMax.x += CalcGlyphRunOffsetX(_cachedGlyphAdvances, selEndGr, selEnd);
                 pMax.y += selEndGr.height;
                 drawList->AddRectFilled(pMin, pMax, styleSelectionColor);
             }
@@ -793,30 +1132,36 @@ void Ionl::TextEdit::Show() {
     }
 
     // Draw text
-    for (auto& glyphRun : _cachedGlyphRuns) {
-        auto& face = gMarkdownStylesheet.LookupFace(glyphRun.tr.style);
-
-        auto absPos = bb.Min + glyphRun.pos;
-        auto font = face.font;
-        auto color = face.color == 0 ? styleTextColor : face.color;
-        drawList->AddText(font, font->FontSize, absPos, color, &_tb->gapBuffer.buffer[glyphRun.tr.begin], &_tb->gapBuffer.buffer[glyphRun.tr.end]);
-
-        if (glyphRun.tr.style.isUnderline) {
-            float y = absPos.y + font->FontSize;
-            drawList->AddLine(ImVec2(absPos.x, y), ImVec2(absPos.x + glyphRun.horizontalAdvance, y), color);
-        }
-        if (glyphRun.tr.style.isStrikethrough) {
-            float y = absPos.y + font->FontSize / 2;
-            drawList->AddLine(ImVec2(absPos.x, y), ImVec2(absPos.x + glyphRun.horizontalAdvance, y), color);
-        }
+    // Tessellating glyphs is most of the cost, so the vertices are kept around until the layout or the colors change.
+    // They cover a viewport's height more on each side of the visible lines, so that scrolling reuses them too.
+    ImVec2 originInt(std::floor(bb.Min.x), std::floor(bb.Min.y));
+    GlyphRunDrawCache::Key drawCacheKey{
+        .dataVersion = _cachedDataVersion,
+        .viewportWidth = _cachedViewportWidth,
+        .originFracX = bb.Min.x - originInt.x,
+        .originFracY = bb.Min.y - originInt.y,
+        .textColor = styleTextColor,
+        .drawListFlags = drawList->Flags,
+        .textureId = drawList->_CmdHeader.TextureId,
+        .texUvWhitePixel = drawList->_Data->TexUvWhitePixel,
+    };
+    if (!(_drawCache.key == drawCacheKey) || visibleBegin < _drawCache.firstRun || visibleEnd > _drawCache.lastRun) {
+        float margin = clipMaxY - clipMinY;
+        auto [first, last] = FindGlyphRunsBetweenY(_cachedGlyphRuns, clipMinY - margin, clipMaxY + margin);
+        _drawCache.key = drawCacheKey;
+        FillGlyphRunDrawCache(_drawCache, *drawList, _tb->gapBuffer, _cachedGlyphRuns, first, last);
     }
+    ReplayGlyphRunDrawCache(_drawCache, drawList, originInt, visibleBegin, visibleEnd);
 
     // Draw cursor
     // TODO move drawing cursor blinking outside the ImGui loop
     if (activeId == _id) {
         _cursorAnimTimer += io.DeltaTime;
 
-        bool cursorVisible = ImFmod(_cursorAnimTimer, 1.20f) <= 0.80f;
+        float blinkPhase = ImFmod(_cursorAnimTimer, 1.20f);
+        bool cursorVisible = blinkPhase <= 0.80f;
+        // Draw the next blink even if there is no input until then
+        RequestFrameWithin(cursorVisible ? 0.80f - blinkPhase : 1.20f - blinkPhase);
         ImVec2 cursorPos = bb.Min + _cursorVisualOffset;
         ImRect cursorRect{
             cursorPos.x,
@@ -869,6 +1214,7 @@ void Ionl::TextEdit::Show() {
         ImGui::Text("_cursorAffinity = %s", StringifyCursorAffinity(_cursorAffinity));
         ImGui::Text("_cursorVisualOffset = (%f, %f)", _cursorVisualOffset.x, _cursorVisualOffset.y);
         ImGui::Text("_cursorVisualHeight = %f", _cursorVisualHeight);
+        ImGui::Text("Cursor paragraph = %" PRId64 " of %" PRId64, FindParagraphContaining(_tb->gapBuffer, _cursorIdx), GetParagraphCount(_tb->gapBuffer));
         ImGui::Text("_cursorCurrGlyphRun = [%zu]", _cursorCurrGlyphRun);
         ImGui::Indent();
         ShowDebugGlyphRun(ctx, _cachedGlyphRuns[_cursorCurrGlyphRun]);
@@ -896,6 +1242,19 @@ void Ionl::TextEdit::Show() {
             WidenGap(_tb->gapBuffer, _debugDesiredGapSize);
         }
 
+        ImGui::InputText("Find", &_debugFindText);
+        ImGui::InputText("Replace", &_debugReplaceText);
+        ImGui::Checkbox("Case insensitive", &_debugFindCaseInsensitive);
+        if (ImGui::Button("Replace all")) {
+            _debugLastReplaceCount = ReplaceAll(SearchPattern(_debugFindText, _debugFindCaseInsensitive), _debugReplaceText);
+        }
+        ImGui::SameLine();
+        ImGui::Text("Replaced %" PRId64 " matches", _debugLastReplaceCount);
+
+        if (auto journal = _tb->gapBuffer.undoJournal.get()) {
+            ShowUndoJournal(*journal);
+        }
+
         ImGui::Checkbox("Show GapBuffer contents", &_debugShowGapBufferDump);
         if (_debugShowGapBufferDump) {
             ImGui::Begin("dbg: TextEdit._tb->gapBuffer");
@@ -977,3 +1336,95 @@ void Ionl::TextEdit::SetAnchorToCursor() {
     _anchorIdx = _cursorIdx;
     RefreshCursorState(*this);
 }
+
+int64_t Ionl::TextEdit::ReplaceAll(const SearchPattern& pattern, std::string_view replacement) {
+    auto& buf = _tb->gapBuffer;
+
+    std::vector<int64_t> matches;
+    FindAllMatches(buf, pattern, matches);
+    if (matches.empty()) {
+        return 0;
+    }
+
+    std::vector<ImWchar> replacementText(replacement.size());
+    replacementText.resize(Utf8Decode(replacementText.data(), (int64_t)replacementText.size(), replacement.data(), replacement.data() + replacement.size()));
+
+    auto matchSize = (int64_t)pattern.text.size();
+    auto replacementSize = (int64_t)replacementText.size();
+    int64_t delta = replacementSize - matchSize;
+
+    // NOTE: ApplyEdits() is slower here: matches come sorted, so edits applied back-to-front only move the gap in one
+    // direction, and growing the gap a little at a time lets realloc() extend the storage in place, while the batched
+    // sweep has to rewrite (and fault in) the whole storage after one big widening.
+    // The edits record themselves as they are made, grouped into a single undo step.
+    auto journal = buf.undoJournal.get();
+    if (journal) {
+        journal->BeginGroup();
+    }
+
+    // Back to front, so that the indices of the matches not yet replaced stay valid
+    for (size_t k = matches.size(); k-- > 0;) {
+        int64_t begin = matches[k];
+        int64_t end = begin + matchSize;
+        MoveGapToLogicalIndex(buf, end);
+        DeleteFromGap(buf, -matchSize);
+        if (replacementSize > 0) {
+            InsertAtGap(buf, replacementText.data(), replacementText.size());
+        }
+
+        for (int64_t* pos : { &_cursorIdx, &_anchorIdx }) {
+            if (*pos >= end) {
+                *pos += delta;
+            } else if (*pos > begin) {
+                *pos = begin + replacementSize;
+            }
+        }
+    }
+
+    if (journal) {
+        journal->EndGroup();
+    }
+
+    _tb->RefreshCaches();
+
+    return (int64_t)matches.size();
+}
+
+int Ionl::LayTextEditsInParallel(WorkerPool& pool, std::span<const TextEditLayoutRequest> requests) {
+    // Only the ones Show() would lay out, grouped into jobs
+    std::vector<TextEditLayoutRequest> stale;
+    std::vector<size_t> jobEnds;
+    int64_t jobContentSize = 0;
+    for (auto& req : requests) {
+        if (IsTextEditCachedDataCurrent(*req.textEdit, req.viewportWidth)) {
+            continue;
+        }
+        stale.push_back(req);
+        jobContentSize += req.textEdit->_tb->gapBuffer.GetContentSize();
+        if (jobContentSize >= kLayoutJobContentSize) {
+            jobEnds.push_back(stale.size());
+            jobContentSize = 0;
+        }
+    }
+    if (jobEnds.empty() || jobEnds.back() != stale.size()) {
+        jobEnds.push_back(stale.size());
+    }
+
+    // The UI thread would only be waiting otherwise, so it takes the last job itself
+    auto jobRequests = [&](size_t job) {
+        size_t begin = job == 0 ? 0 : jobEnds[job - 1];
+        return std::span(stale).subspan(begin, jobEnds[job] - begin);
+    };
+    size_t numSubmitted = jobEnds.size() - 1;
+    std::latch jobsDone((ptrdiff_t)numSubmitted);
+    for (size_t job = 0; job < numSubmitted; ++job) {
+        pool.Submit([&jobsDone, requests = jobRequests(job)]() {
+            RefreshTextEditsCachedData(requests);
+            jobsDone.count_down();
+        });
+    }
+    RefreshTextEditsCachedData(jobRequests(numSubmitted));
+    jobsDone.wait();
+
+    return (int)stale.size();
+}
@@ -8,13 +8,18 @@
 #include <ionl/gap_buffer.hpp>
 #include <ionl/markdown.hpp>
 #include <ionl/text_buffer.hpp>
+#include <ionl/text_search.hpp>
 
+#include <limits>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
 
 namespace Ionl {
 
+class WorkerPool;
+
 // TODO DPI handling?
 // TODO figure out font caching or SDF based rendering: generating a separate atlas for each heading type is really costly on VRAM
 
@@ -25,10 +30,90 @@ struct GlyphRun {
     ImVec2 pos;
     float horizontalAdvance = 0.0f; // == <used MarkdownStylesheet>.LookupFace(this->tr.style).CalcTextSize(... contents of this GlyphRun ...)
     float height = 0.0f; // == <used MarkdownStylesheet>.LookupFace(this->tr.style).FontSize
+    // Index into LayoutOutput::glyphAdvances where this run's cumulative advances begin, one for each of its glyphs
+    int32_t advancesBegin = 0;
 
     // Whether this TextRun is on a new line, created by soft wrapping
     bool isSoftWrapped = false;
 };
+static_assert(sizeof(GlyphRun) == 36);
+
+struct LayoutInput {
+    // [Required] Markdown styling.
+    const MarkdownStylesheet* styles;
+    // [Required] Source buffer which generated the TextRun's.
+    const GapBuffer* src;
+    // [Required]
+    std::span<const TextRun> textRuns;
+    // [Optional] Width to wrap lines at; set to 0.0f to ignore line width.
+    float viewportWidth = std::numeric_limits<float>::max();
+    // [Optional] Vertical position of the first TextRun, which must begin a paragraph. For laying out only part of the text.
+    float startY = 0.0f;
+};
+
+struct LayoutOutput {
+    std::vector<GlyphRun> glyphRuns;
+    // For each GlyphRun: x of the right edge of each of its glyphs, relative to GlyphRun::pos. Laid out in the same order
+    // as `glyphRuns`, but RelayMarkdownTextRuns() may leave unreferenced entries around.
+    std::vector<float> glyphAdvances;
+    ImVec2 boundingBox;
+};
+
+/// Break TextRun's into lines no wider than the viewport. Needs the fonts in `styles` to be loaded, but not an ImGui frame.
+LayoutOutput LayMarkdownTextRuns(const LayoutInput& in);
+/// Same as above, but reuses the storage of `out` (its previous contents are replaced).
+void LayMarkdownTextRuns(const LayoutInput& in, LayoutOutput& out);
+
+/// Update a layout of `tb.textRuns` made for the previous TextBuffer::cacheDataVersion to the current one, by laying out
+/// again only the paragraphs that TextBuffer::lastChange touched, and shifting everything after them.
+/// \param glyphRuns Layout of the previous version, at the same `viewportWidth`.
+/// \param glyphAdvances LayoutOutput::glyphAdvances that goes with `glyphRuns`. New advances get appended.
+/// \param contentHeight Height of the previous layout, i.e. LayoutOutput::boundingBox.y.
+/// \param scratch Reused storage for the paragraphs being laid out.
+/// \return false if `tb` has no usable previous version, in which case nothing gets modified.
+bool RelayMarkdownTextRuns(const MarkdownStylesheet& styles, const TextBuffer& tb, float viewportWidth, std::vector<GlyphRun>& glyphRuns, std::vector<float>& glyphAdvances, float& contentHeight, LayoutOutput& scratch);
+
+/// Distance from `glyphRun.pos.x` to the left edge of the glyph at `bufferIdx`, which is clamped to the run. O(1).
+float CalcGlyphRunOffsetX(std::span<const float> glyphAdvances, const GlyphRun& glyphRun, int64_t bufferIdx);
+/// Buffer index of the first glyph in `glyphRun` whose center is right of `x` (relative to `glyphRun.pos.x`), or
+/// `glyphRun.tr.end` if there is none. O(log n).
+int64_t FindGlyphRunIndexAtX(std::span<const float> glyphAdvances, const GlyphRun& glyphRun, float x);
+
+/// Text of a range of GlyphRun's tessellated once, and copied into the window's ImDrawList every frame for as long as
+/// nothing it was made with changes.
+struct GlyphRunDrawCache {
+    struct Key {
+        int dataVersion = -1;
+        float viewportWidth = 0.0f;
+        // Fractional part of the draw origin, which glyph positions are rounded with. Vertices are placed relative to
+        // the integer part, so that a replay is an exact translation.
+        float originFracX = 0.0f;
+        float originFracY = 0.0f;
+        ImU32 textColor = 0;
+        ImDrawListFlags drawListFlags = 0;
+        // Fonts are only built at startup, these catch the texture being uploaded again
+        ImTextureID textureId = nullptr;
+        ImVec2 texUvWhitePixel;
+
+        bool operator==(const Key& that) const {
+            return dataVersion == that.dataVersion && viewportWidth == that.viewportWidth &&
+                   originFracX == that.originFracX && originFracY == that.originFracY &&
+                   textColor == that.textColor && drawListFlags == that.drawListFlags &&
+                   textureId == that.textureId && texUvWhitePixel.x == that.texUvWhitePixel.x && texUvWhitePixel.y == that.texUvWhitePixel.y;
+        }
+    };
+
+    Key key;
+    // Range [firstRun, lastRun) of the GlyphRun's cached
+    size_t firstRun = 0;
+    size_t lastRun = 0;
+    std::vector<ImDrawVert> vertices;
+    // Relative to the first vertex of the GlyphRun they belong to
+    std::vector<ImDrawIdx> indices;
+    // Where each GlyphRun's vertices and indices begin, plus one more element for the end of the last GlyphRun
+    std::vector<int32_t> runVertexBegin;
+    std::vector<int32_t> runIndexBegin;
+};
 
 enum class CursorAffinity {
     Irrelevant,
@@ -43,6 +128,7 @@ CursorAffinity ToggleCursorAffinity(CursorAffinity v);
 struct TextEdit {
     TextBuffer* _tb;
     std::vector<GlyphRun> _cachedGlyphRuns;
+    std::vector<float> _cachedGlyphAdvances;
 
     // TODO should we move all of these to a global shared state like ImGui::InputText()?
     //   b/c there can only be one active text edit at any given time anyways, so this could simply this widget down to Ionl::TextEdit(GapBuffer& document);
@@ -82,6 +168,9 @@ struct TextEdit {
     float _cachedContentHeight = 0.0f;
     float _cachedViewportWidth = 0.0f;
     int _cachedDataVersion = 0;
+    // Reused when relaying out only the edited paragraphs
+    LayoutOutput _relayoutScratch;
+    GlyphRunDrawCache _drawCache;
 
     // Whether the cursor is on a wrapping point (end of a soft wrapped line).
     // TODO _cursorAffinity seems to be only not Irrelevant if it is at a wrap point, so this variable is useless?
@@ -95,6 +184,10 @@ struct TextEdit {
     bool _debugShowGapBufferDump = false;
     bool _debugShowTextRuns = false;
     bool _debugShowGlyphRuns = false;
+    std::string _debugFindText;
+    std::string _debugReplaceText;
+    bool _debugFindCaseInsensitive = false;
+    int64_t _debugLastReplaceCount = 0;
 #endif
 
     TextEdit(ImGuiID id, TextBuffer& textBuffer);
@@ -113,6 +206,23 @@ struct TextEdit {
     void SetAnchor(int64_t anchor);
     /// Equivalently, "unselect"
     void SetAnchorToCursor();
+
+    /// Replace every match of `pattern` in the buffer with `replacement` (UTF-8), as a single undo step. Cursor and
+    /// anchor are kept on the same piece of text.
+    /// \return Number of matches replaced.
+    int64_t ReplaceAll(const SearchPattern& pattern, std::string_view replacement);
 };
 
+struct TextEditLayoutRequest {
+    TextEdit* textEdit;
+    // What TextEdit::Show() will get as the available width
+    float viewportWidth;
+};
+
+/// Bring the layout of each TextEdit up to date, as its Show() would, spread over `pool`. For when many of them need it at
+/// once, e.g. every visible bullet after the window got resized, which would stall the frame if done one by one in
+/// Show(). Blocks until done. The TextEdit's must be distinct, but may share TextBuffer's.
+/// \return Number of TextEdit's laid out; the ones already up to date are skipped.
+int LayTextEditsInParallel(WorkerPool& pool, std::span<const TextEditLayoutRequest> requests);
+
 } // namespace Ionl
@@ -0,0 +1,71 @@
+#include "worker_pool.hpp"
+
+#include <algorithm>
+#include <utility>
+
+Ionl::WorkerPool::WorkerPool(int numThreads) {
+    if (numThreads <= 0) {
+        numThreads = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+    }
+
+    mThreads.reserve(numThreads);
+    for (int i = 0; i < numThreads; ++i) {
+        mThreads.emplace_back([this]() { RunWorker(); });
+    }
+}
+
+Ionl::WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mMutex);
+        mStopping = true;
+        mUnfinishedJobs -= (int)mJobs.size();
+        mJobs.clear();
+    }
+    mJobAvailable.notify_all();
+    mAllDone.notify_all();
+
+    for (auto& thread : mThreads) {
+        thread.join();
+    }
+}
+
+void Ionl::WorkerPool::Submit(std::move_only_function<void()> job) {
+    {
+        std::lock_guard lock(mMutex);
+        mJobs.push_back(std::move(job));
+        mUnfinishedJobs += 1;
+    }
+    mJobAvailable.notify_one();
+}
+
+void Ionl::WorkerPool::WaitIdle() {
+    std::unique_lock lock(mMutex);
+    mAllDone.wait(lock, [&]() { return mUnfinishedJobs == 0; });
+}
+
+void Ionl::WorkerPool::RunWorker() {
+    while (true) {
+        std::move_only_function<void()> job;
+        {
+            std::unique_lock lock(mMutex);
+            mJobAvailable.wait(lock, [&]() { return mStopping || !mJobs.empty(); });
+            if (mStopping) {
+                return;
+            }
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+
+        job();
+
+        bool isIdle;
+        {
+            std::lock_guard lock(mMutex);
+            mUnfinishedJobs -= 1;
+            isIdle = mUnfinishedJobs == 0;
+        }
+        if (isIdle) {
+            mAllDone.notify_all();
+        }
+    }
+}
@@ -0,0 +1,46 @@
+// A fixed set of background threads, for work that is independent per bullet (e.g. parsing a freshly loaded subtree)
+// and would otherwise stall the UI thread.
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Ionl {
+
+class WorkerPool {
+private:
+    std::vector<std::thread> mThreads;
+    std::deque<std::move_only_function<void()>> mJobs;
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mAllDone;
+    // Number of jobs queued or running
+    int mUnfinishedJobs = 0;
+    bool mStopping = false;
+
+public:
+    /// \param numThreads 0 to use one thread less than the number of hardware threads (leaving one for the UI thread),
+    ///                   but always at least one.
+    explicit WorkerPool(int numThreads = 0);
+    /// Jobs that haven't started yet are discarded, the ones running are waited for.
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    int GetThreadCount() const { return (int)mThreads.size(); }
+
+    /// Jobs are started in the order they were submitted. They must not throw.
+    void Submit(std::move_only_function<void()> job);
+    /// Block until all submitted jobs have finished.
+    void WaitIdle();
+
+private:
+    void RunWorker();
+};
+
+} // namespace Ionl
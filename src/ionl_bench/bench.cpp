@@ -0,0 +1,212 @@
+#include "bench.hpp"
+
+#include <ionl/markdown.hpp>
+#include <ionl/undo_journal.hpp>
+#include <ionl/utf8.hpp>
+
+#include <imgui/imgui.h>
+
+#include <cstdlib>
+#include <new>
+
+using namespace Ionl;
+using namespace IonlBench;
+
+std::atomic<int64_t> IonlBench::gAllocationCount = 0;
+
+static void* CountedAllocate(size_t size) noexcept {
+    gAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new(size_t size) {
+    if (void* p = CountedAllocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    if (void* p = CountedAllocate(size)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAllocate(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAllocate(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+BenchOptions IonlBench::gOptions;
+std::vector<BenchResult> IonlBench::gResults;
+volatile int64_t IonlBench::gSink;
+
+std::string IonlBench::GenerateText(int64_t targetBytes, uint32_t seed) {
+    static constexpr std::string_view kWords[] = {
+        "the", "outline", "bullet", "of", "and", "a", "gap", "buffer", "to", "in", "is", "**bold**", "*italic*",
+        "`code`", "https://example.com", "café", "naïve", "日本語", "text", "editor", "with", "paragraph", "for",
+    };
+    constexpr int kWordCount = sizeof(kWords) / sizeof(kWords[0]);
+
+    std::mt19937 rng(seed);
+    std::string result;
+    result.reserve(targetBytes + 32);
+    int wordsInLine = 0;
+    while ((int64_t)result.size() < targetBytes) {
+        // Plain ASCII words are much more likely, to stay close to what most text looks like
+        int idx = rng() % 4 == 0 ? rng() % kWordCount : rng() % 11;
+        result += kWords[idx];
+        if (++wordsInLine >= 8 + (int)(rng() % 40)) {
+            result += '\n';
+            wordsInLine = 0;
+        } else {
+            result += ' ';
+        }
+    }
+    // Cut at a codepoint boundary
+    while ((int64_t)result.size() > targetBytes && ((unsigned char)result.back() & 0xC0) == 0x80) {
+        result.pop_back();
+    }
+    if ((int64_t)result.size() > targetBytes) {
+        result.pop_back();
+    }
+    return result;
+}
+
+std::vector<std::string_view> IonlBench::SplitLines(std::string_view content) {
+    std::vector<std::string_view> lines;
+    size_t begin = 0;
+    while (begin < content.size()) {
+        size_t end = content.find('\n', begin);
+        if (end == std::string_view::npos) end = content.size();
+        lines.push_back(content.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return lines;
+}
+
+std::string IonlBench::RandomMarkdownText(std::mt19937& rng, int64_t maxSize) {
+    constexpr std::string_view kAlphabet = "ab *_`~#\\\n";
+
+    std::string result(rng() % (maxSize + 1), '\0');
+    for (auto& c : result) c = kAlphabet[rng() % kAlphabet.size()];
+    return result;
+}
+
+void IonlBench::DoRandomEdits(GapBuffer& buf, std::mt19937& rng) {
+    auto randomIndex = [&]() {
+        return (int64_t)(rng() % (buf.GetContentSize() + 1));
+    };
+
+    // Sometimes do a few edits before refreshing, like when a paste or undo happens between frames
+    int numEdits = rng() % 4 == 0 ? 1 + rng() % 4 : 1;
+    for (int i = 0; i < numEdits; ++i) {
+        switch (rng() % 8) {
+            case 0:
+            case 1:
+            case 2: {
+                MoveGapToLogicalIndex(buf, randomIndex());
+                auto text = RandomMarkdownText(rng, 8);
+                InsertAtGap(buf, text.data(), text.size());
+            } break;
+            case 3:
+            case 4: {
+                MoveGapToLogicalIndex(buf, randomIndex());
+                int64_t offset = (int64_t)(rng() % 9) - 4;
+                DeleteFromGap(buf, offset);
+            } break;
+            case 5: {
+                // Replace a few non-overlapping ranges at once
+                std::vector<int64_t> points;
+                for (int k = 0; k < 6; ++k) points.push_back(randomIndex());
+                std::sort(points.begin(), points.end());
+                std::vector<std::vector<ImWchar>> texts;
+                std::vector<GapBufferEdit> edits;
+                for (int k = 0; k < 3; ++k) {
+                    // All ASCII, no need to go through UTF-8 decoding
+                    auto text = RandomMarkdownText(rng, 4);
+                    auto& wide = texts.emplace_back(text.begin(), text.end());
+                    edits.push_back(GapBufferEdit{ .begin = points[k * 2], .end = points[k * 2 + 1], .text = wide.data(), .textSize = wide.size() });
+                }
+                ApplyEdits(buf, edits);
+            } break;
+            case 6: {
+                if (rng() % 2 == 0) {
+                    Undo(*buf.undoJournal, buf);
+                } else {
+                    Redo(*buf.undoJournal, buf);
+                }
+            } break;
+            case 7: {
+                // Refresh without any edits, only moving the gap around
+                MoveGapToLogicalIndex(buf, randomIndex());
+            } break;
+        }
+    }
+}
+
+int64_t IonlBench::ScaleOps(int64_t contentBytes, int64_t budgetBytes, int64_t minOps, int64_t maxOps) {
+    return std::clamp<int64_t>(budgetBytes / std::max<int64_t>(contentBytes, 1), minOps, maxOps);
+}
+
+bool IonlBench::IsWorkloadSelected(std::string_view workload, std::string_view backend) {
+    if (!gOptions.filter) {
+        return true;
+    }
+    std::string fullName = std::string(workload) + "/" + std::string(backend);
+    return fullName.find(gOptions.filter) != std::string::npos;
+}
+
+WorkerPool& IonlBench::GetWorkerPool() {
+    static WorkerPool pool(gOptions.threads);
+    return pool;
+}
+
+void IonlBench::SetupLayoutFonts() {
+    ImGui::CreateContext();
+    auto& io = ImGui::GetIO();
+    io.IniFilename = nullptr;
+    ImFont* font = io.Fonts->AddFontDefault();
+    io.Fonts->Build();
+
+    MarkdownFace face{ .font = font };
+    for (int i = 0; i < 1 << 3; ++i) {
+        gMarkdownStylesheet.SetRegularFace(face, i & 1, i & 2, i & 4);
+    }
+    for (int level = 1; level <= kNumTitleLevels; ++level) {
+        gMarkdownStylesheet.SetHeadingFace(face, level);
+    }
+}
+
+bool IonlBench::ReportCheck(const char* name, bool passed) {
+    fprintf(stderr, "%s: %s\n", name, passed ? "OK" : "FAILED");
+    return passed;
+}
+
+void IonlBench::WriteResults(FILE* out) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"utf8_kernel\": \"%s\",\n", GetUtf8KernelName());
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < gResults.size(); ++i) {
+        auto& r = gResults[i];
+        double nsPerOp = r.medianSeconds * 1e9 / (double)std::max<int64_t>(r.opsPerRun, 1);
+        double mbPerSecond = r.bytesPerRun > 0 ? (double)r.bytesPerRun / r.medianSeconds / 1e6 : 0.0;
+        double allocationsPerOp = (double)r.allocationsPerRun / (double)std::max<int64_t>(r.opsPerRun, 1);
+        fprintf(out,
+            "    { \"workload\": \"%s\", \"backend\": \"%s\", \"content_bytes\": %lld, \"ops_per_run\": %lld, \"runs\": %d, "
+            "\"min_ms\": %.4f, \"median_ms\": %.4f, \"ns_per_op\": %.1f, \"mb_per_s\": %.1f, \"allocs_per_op\": %.2f }%s\n",
+            r.workload.c_str(),
+            r.backend.c_str(),
+            (long long)r.contentBytes,
+            (long long)r.opsPerRun,
+            r.runs,
+            r.minSeconds * 1e3,
+            r.medianSeconds * 1e3,
+            nsPerOp,
+            mbPerSecond,
+            allocationsPerOp,
+            i + 1 < gResults.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n");
+    fprintf(out, "}\n");
+}
@@ -0,0 +1,138 @@
+// Shared fixture of IonlBench: timing and reporting, generated content, and the setup several areas need.
+#pragma once
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/worker_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace IonlBench {
+
+struct BenchOptions {
+    const char* filter = nullptr;
+    const char* outPath = nullptr;
+    // Minimum total time measured per benchmark
+    double minTotalSeconds = 0.2;
+    int minRuns = 3;
+    int maxRuns = 100;
+    // Size of the WorkerPool used by the parallel workloads, 0 for the same default as the app
+    int threads = 0;
+};
+
+struct BenchResult {
+    std::string workload;
+    std::string backend;
+    int64_t contentBytes;
+    // Number of operations (keystrokes, jumps, pastes, ...) in a single run
+    int64_t opsPerRun;
+    // Number of bytes processed by a single run, for computing throughput. 0 if it doesn't apply.
+    int64_t bytesPerRun;
+    int runs;
+    double minSeconds;
+    double medianSeconds;
+    // Heap allocations made by the timed part of the last run
+    int64_t allocationsPerRun;
+};
+
+extern BenchOptions gOptions;
+extern std::vector<BenchResult> gResults;
+
+using Clock = std::chrono::steady_clock;
+
+// Number of heap allocations made so far, counted by the replacement operator new's
+// NOTE: includes allocations made by worker threads
+extern std::atomic<int64_t> gAllocationCount;
+
+// Prevent the compiler from optimizing away computations whose results are otherwise unused
+extern volatile int64_t gSink;
+
+// Markdown-ish prose: words of varying length, a newline every few dozen words, some formatting, and a sprinkle of
+// non-ASCII text (2 and 3 byte UTF-8 sequences)
+std::string GenerateText(int64_t targetBytes, uint32_t seed);
+
+// Split into one bullet per line, like an outline would store it
+std::vector<std::string_view> SplitLines(std::string_view content);
+
+// Mostly characters that mean something to the parser, so that formatting gets created and broken all the time
+std::string RandomMarkdownText(std::mt19937& rng, int64_t maxSize);
+
+// What may happen to a TextBuffer between two frames: one or a few edits of any kind, or only the gap moving around
+void DoRandomEdits(Ionl::GapBuffer& buf, std::mt19937& rng);
+
+// Scale operation counts so that the total memory traffic stays roughly the same across content sizes
+int64_t ScaleOps(int64_t contentBytes, int64_t budgetBytes, int64_t minOps, int64_t maxOps);
+
+bool IsWorkloadSelected(std::string_view workload, std::string_view backend);
+
+Ionl::WorkerPool& GetWorkerPool();
+
+// LayMarkdownTextRuns() measures text with the stylesheet's fonts, which only needs a built font atlas and no window.
+// Every face uses ImGui's default font, so this measures the layout loop itself rather than font differences.
+void SetupLayoutFonts();
+
+/// \param setup Called before every run, outside of the timed region. Returns the state passed to `run`.
+/// \param run Called with the state, timed.
+template <typename TSetup, typename TRun>
+void Bench(std::string_view workload, std::string_view backend, int64_t contentBytes, int64_t opsPerRun, int64_t bytesPerRun, TSetup&& setup, TRun&& run) {
+    if (!IsWorkloadSelected(workload, backend)) {
+        return;
+    }
+    std::string fullName = std::string(workload) + "/" + std::string(backend);
+
+    std::vector<double> samples;
+    double total = 0.0;
+    int64_t allocations = 0;
+    while ((int)samples.size() < gOptions.maxRuns &&
+           ((int)samples.size() < gOptions.minRuns || total < gOptions.minTotalSeconds)) //
+    {
+        auto state = setup();
+        int64_t allocationsBegin = gAllocationCount;
+        auto begin = Clock::now();
+        run(state);
+        auto end = Clock::now();
+        allocations = gAllocationCount - allocationsBegin;
+
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        samples.push_back(seconds);
+        total += seconds;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    gResults.push_back(BenchResult{
+        .workload = std::string(workload),
+        .backend = std::string(backend),
+        .contentBytes = contentBytes,
+        .opsPerRun = opsPerRun,
+        .bytesPerRun = bytesPerRun,
+        .runs = (int)samples.size(),
+        .minSeconds = samples.front(),
+        .medianSeconds = samples[samples.size() / 2],
+        .allocationsPerRun = allocations,
+    });
+    fprintf(stderr, "%-40s %10lld B  %10.3f ms\n", fullName.c_str(), (long long)contentBytes, samples[samples.size() / 2] * 1e3);
+}
+
+/// Print the outcome of a --verify check.
+/// \return `passed`
+bool ReportCheck(const char* name, bool passed);
+
+void WriteResults(FILE* out);
+
+// Each area runs all of its workloads on `content`, and all of its --verify checks. Layout (including the checks) needs
+// SetupLayoutFonts().
+void RunTextStorageBenches(const std::string& content, const std::string& clipboard);
+bool RunTextStorageChecks(bool quick);
+void RunParsingBenches(const std::string& content);
+bool RunParsingChecks(bool quick);
+void RunLayoutBenches(const std::string& content);
+bool RunLayoutChecks(bool quick);
+
+} // namespace IonlBench
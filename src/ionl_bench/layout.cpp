@@ -0,0 +1,541 @@
+// Workloads on laying out parsed text and showing it: GlyphRun layout, cursor placement, whole TextEdit frames, and
+// relaying out many bullets when the width changes.
+
+#include "bench.hpp"
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/markdown.hpp>
+#include <ionl/text_buffer.hpp>
+#include <ionl/widget_misc.hpp>
+#include <ionl/widget_text_edit.hpp>
+
+#include <imgui/imgui.h>
+#include <imgui/imgui_internal.h>
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Ionl;
+using namespace IonlBench;
+
+namespace {
+void BenchLayout(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+
+    TextBuffer tb{ GapBuffer(content) };
+    MoveGapToLogicalIndex(tb.gapBuffer, tb.gapBuffer.GetContentSize() / 2);
+    tb.RefreshCaches();
+
+    // Same as what TextEdit does when the text or the viewport width changes
+    auto noState = []() { return 0; };
+    Bench("layout", "LayMarkdownTextRuns", contentBytes, 1, contentBytes, noState, [&](int) {
+        auto res = LayMarkdownTextRuns({
+            .styles = &gMarkdownStylesheet,
+            .src = &tb.gapBuffer,
+            .textRuns = std::span(tb.textRuns),
+            .viewportWidth = 600.0f,
+        });
+        gSink = (int64_t)res.glyphRuns.size();
+    });
+}
+
+void BenchCursorOffsets(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    constexpr int64_t kQueries = 10000;
+
+    TextBuffer tb{ GapBuffer(content) };
+    tb.RefreshCaches();
+    auto layout = LayMarkdownTextRuns({
+        .styles = &gMarkdownStylesheet,
+        .src = &tb.gapBuffer,
+        .textRuns = std::span(tb.textRuns),
+        .viewportWidth = 600.0f,
+    });
+    if (layout.glyphRuns.empty()) {
+        return;
+    }
+
+    // Same as what TextEdit does to place the cursor and the selection edges: x of a buffer index inside a GlyphRun
+    std::mt19937 rng(7);
+    std::vector<std::pair<size_t, int64_t>> queries;
+    queries.reserve(kQueries);
+    for (int64_t i = 0; i < kQueries; ++i) {
+        size_t grIdx = rng() % layout.glyphRuns.size();
+        auto& gr = layout.glyphRuns[grIdx];
+        queries.push_back({ grIdx, gr.tr.begin + rng() % (gr.tr.end - gr.tr.begin + 1) });
+    }
+
+    auto noState = []() { return 0; };
+    Bench("cursor_offset_x", "CalcTextSize", contentBytes, kQueries, 0, noState, [&](int) {
+        float sum = 0.0f;
+        for (auto [grIdx, idx] : queries) {
+            auto& gr = layout.glyphRuns[grIdx];
+            auto font = gMarkdownStylesheet.LookupFace(gr.tr.style).font;
+            auto buf = tb.gapBuffer.buffer;
+            sum += font->CalcTextSize(font->FontSize, std::numeric_limits<float>::max(), 0.0f, &buf[gr.tr.begin], &buf[idx]).x;
+        }
+        gSink = (int64_t)sum;
+    });
+    Bench("cursor_offset_x", "glyphAdvances", contentBytes, kQueries, 0, noState, [&](int) {
+        float sum = 0.0f;
+        for (auto [grIdx, idx] : queries) {
+            sum += CalcGlyphRunOffsetX(layout.glyphAdvances, layout.glyphRuns[grIdx], idx);
+        }
+        gSink = (int64_t)sum;
+    });
+}
+
+// Run one ImGui frame, without a window or renderer, showing `te` in a 600x400 window scrolled to `scrollY`. Needs
+// SetupLayoutFonts().
+// \return Number of vertices drawn.
+int ShowTextEditFrame(TextEdit& te, float scrollY) {
+    auto& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(800.0f, 600.0f);
+    io.DeltaTime = 1.0f / 60.0f;
+
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+    ImGui::SetNextWindowSize(ImVec2(600.0f, 400.0f));
+    ImGui::SetNextWindowScroll(ImVec2(0.0f, scrollY));
+    ImGui::Begin("Bullet");
+    te.Show();
+    ImGui::End();
+    ImGui::Render();
+    return ImGui::GetDrawData()->TotalVtxCount;
+}
+
+void BenchShowTextEdit(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    constexpr int64_t kFrames = 20;
+
+    TextBuffer tb{ GapBuffer(content) };
+    tb.RefreshCaches();
+    TextEdit te(ImHashStr("bench"), tb);
+    // Lay out, and let the window learn its content height so that it can be scrolled
+    ShowTextEditFrame(te, 0.0f);
+    float scrollY = te._cachedContentHeight / 2;
+
+    // Same as a steady frame with one long bullet on screen, scrolled to its middle
+    auto noState = []() { return 0; };
+    int numVertices = 0;
+    Bench("show_text_edit", "TextEdit", contentBytes, kFrames, 0, noState, [&](int) {
+        for (int64_t i = 0; i < kFrames; ++i) {
+            numVertices = ShowTextEditFrame(te, scrollY);
+        }
+        gSink = numVertices;
+    });
+}
+
+// One TextEdit per line of `content`, as the bullets of a document
+struct TextEditBullets {
+    std::vector<TextBuffer> buffers;
+    std::vector<std::unique_ptr<TextEdit>> textEdits;
+
+    explicit TextEditBullets(const std::string& content) {
+        auto lines = SplitLines(content);
+        buffers.reserve(lines.size());
+        for (auto line : lines) {
+            auto& tb = buffers.emplace_back(GapBuffer(line));
+            tb.RefreshCaches();
+            textEdits.push_back(std::make_unique<TextEdit>(ImHashStr("bullet") + (ImGuiID)textEdits.size(), tb));
+        }
+    }
+
+    std::vector<TextEditLayoutRequest> MakeLayoutRequests(float viewportWidth) const {
+        std::vector<TextEditLayoutRequest> requests;
+        for (auto& te : textEdits) {
+            requests.push_back({ te.get(), viewportWidth });
+        }
+        return requests;
+    }
+};
+
+void BenchRelayoutBullets(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+
+    TextEditBullets bullets(content);
+    auto numBullets = (int64_t)bullets.textEdits.size();
+    // Alternate between two widths, so that every run lays out all of them, same as dragging the window's edge
+    auto widths = [](int run) { return run % 2 == 0 ? 600.0f : 580.0f; };
+    int run = 0;
+
+    // Same as what each TextEdit::Show() does on its own when the width changes
+    auto noState = []() { return 0; };
+    Bench("relayout_bullets", "serial", contentBytes, numBullets, contentBytes, noState, [&](int) {
+        float width = widths(run++);
+        for (auto& tb : bullets.buffers) {
+            auto res = LayMarkdownTextRuns({
+                .styles = &gMarkdownStylesheet,
+                .src = &tb.gapBuffer,
+                .textRuns = std::span(tb.textRuns),
+                .viewportWidth = width,
+            });
+            gSink = (int64_t)res.glyphRuns.size();
+        }
+    });
+
+    auto backend = "WorkerPool/" + std::to_string(GetWorkerPool().GetThreadCount()) + "threads";
+    Bench("relayout_bullets", backend, contentBytes, numBullets, contentBytes, noState, [&](int) {
+        auto requests = bullets.MakeLayoutRequests(widths(run++));
+        gSink = LayTextEditsInParallel(GetWorkerPool(), requests);
+    });
+}
+
+void BenchTextBufferTypingWithLayout(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    constexpr int64_t kKeystrokes = 200;
+    constexpr std::string_view kTyped = "some **bold** text\n";
+    constexpr float kViewportWidth = 600.0f;
+
+    struct State {
+        TextBuffer tb;
+        std::vector<GlyphRun> glyphRuns;
+        std::vector<float> glyphAdvances;
+        float contentHeight = 0.0f;
+        LayoutOutput scratch;
+    };
+    auto setup = [&]() {
+        State s{ .tb = TextBuffer{ GapBuffer(content) }, .glyphRuns = {}, .glyphAdvances = {}, .contentHeight = 0.0f, .scratch = {} };
+        MoveGapToLogicalIndex(s.tb.gapBuffer, s.tb.gapBuffer.GetContentSize() / 2);
+        s.tb.RefreshCaches();
+        auto res = LayMarkdownTextRuns({
+            .styles = &gMarkdownStylesheet,
+            .src = &s.tb.gapBuffer,
+            .textRuns = std::span(s.tb.textRuns),
+            .viewportWidth = kViewportWidth,
+        });
+        s.glyphRuns = std::move(res.glyphRuns);
+        s.glyphAdvances = std::move(res.glyphAdvances);
+        s.contentHeight = res.boundingBox.y;
+        return s;
+    };
+
+    // Same as what TextEdit does per keystroke: edit, refresh the parsed TextRun's, then lay them out for the next frame
+    Bench("typing_with_relayout", "LayMarkdownTextRuns", contentBytes, kKeystrokes, 0, setup, [&](State& s) {
+        for (int64_t i = 0; i < kKeystrokes; ++i) {
+            char c = kTyped[i % kTyped.size()];
+            InsertAtGap(s.tb.gapBuffer, &c, 1);
+            s.tb.RefreshCaches();
+            auto res = LayMarkdownTextRuns({
+                .styles = &gMarkdownStylesheet,
+                .src = &s.tb.gapBuffer,
+                .textRuns = std::span(s.tb.textRuns),
+                .viewportWidth = kViewportWidth,
+            });
+            s.glyphRuns = std::move(res.glyphRuns);
+            s.glyphAdvances = std::move(res.glyphAdvances);
+        }
+        gSink = (int64_t)s.glyphRuns.size();
+    });
+    Bench("typing_with_relayout", "RelayMarkdownTextRuns", contentBytes, kKeystrokes, 0, setup, [&](State& s) {
+        for (int64_t i = 0; i < kKeystrokes; ++i) {
+            char c = kTyped[i % kTyped.size()];
+            InsertAtGap(s.tb.gapBuffer, &c, 1);
+            s.tb.RefreshCaches();
+            RelayMarkdownTextRuns(gMarkdownStylesheet, s.tb, kViewportWidth, s.glyphRuns, s.glyphAdvances, s.contentHeight, s.scratch);
+        }
+        gSink = (int64_t)s.glyphRuns.size();
+    });
+}
+
+// Same as VerifyIncrementalReparse(), but for the layout TextEdit keeps up to date with RelayMarkdownTextRuns(), against
+// laying out everything from scratch. Needs SetupLayoutFonts().
+// \return Whether all checks passed.
+bool VerifyIncrementalRelayout(int64_t numSteps) {
+    // Narrow enough that most paragraphs get soft wrapped
+    constexpr float kViewportWidth = 60.0f;
+    // Positions below the edit get moved instead of recomputed, allow for rounding errors piling up
+    constexpr float kTolerance = 1e-2f;
+
+    auto matches = [&](const std::vector<GlyphRun>& got, const std::vector<float>& gotAdvances, float gotHeight, const LayoutOutput& expected) {
+        if (got.size() != expected.glyphRuns.size() || std::abs(gotHeight - expected.boundingBox.y) > kTolerance) {
+            return false;
+        }
+        for (size_t i = 0; i < got.size(); ++i) {
+            auto& a = got[i];
+            auto& b = expected.glyphRuns[i];
+            if (a.tr != b.tr || a.isSoftWrapped != b.isSoftWrapped ||
+                a.pos.x != b.pos.x || std::abs(a.pos.y - b.pos.y) > kTolerance ||
+                a.horizontalAdvance != b.horizontalAdvance || a.height != b.height ||
+                !std::equal(expected.glyphAdvances.data() + b.advancesBegin, expected.glyphAdvances.data() + b.advancesBegin + (b.tr.end - b.tr.begin), gotAdvances.data() + a.advancesBegin))
+            {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    std::mt19937 rng(43);
+    TextBuffer tb{ GapBuffer(RandomMarkdownText(rng, 200)) };
+    auto& buf = tb.gapBuffer;
+
+    auto layAll = [&]() {
+        return LayMarkdownTextRuns({
+            .styles = &gMarkdownStylesheet,
+            .src = &buf,
+            .textRuns = std::span(tb.textRuns),
+            .viewportWidth = kViewportWidth,
+        });
+    };
+    auto initial = layAll();
+    std::vector<GlyphRun> glyphRuns = std::move(initial.glyphRuns);
+    std::vector<float> glyphAdvances = std::move(initial.glyphAdvances);
+    float contentHeight = initial.boundingBox.y;
+    LayoutOutput scratch;
+
+    for (int64_t step = 0; step < numSteps; ++step) {
+        DoRandomEdits(buf, rng);
+        tb.RefreshCaches();
+
+        if (!RelayMarkdownTextRuns(gMarkdownStylesheet, tb, kViewportWidth, glyphRuns, glyphAdvances, contentHeight, scratch)) {
+            fprintf(stderr, "Relayout refused at step %lld\n", (long long)step);
+            return false;
+        }
+        auto expected = layAll();
+        if (!matches(glyphRuns, glyphAdvances, contentHeight, expected)) {
+            fprintf(stderr, "Mismatch at step %lld: got %zu GlyphRun's, expected %zu, content:\n%s\n", (long long)step, glyphRuns.size(), expected.glyphRuns.size(), buf.ExtractContent().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Lay out random text, checking that the x of every buffer index from GlyphRun::glyphAdvances is the same as measuring
+// the text from the beginning of its GlyphRun. Needs SetupLayoutFonts().
+// \return Whether all checks passed.
+bool VerifyGlyphAdvances() {
+    std::mt19937 rng(44);
+    TextBuffer tb{ GapBuffer(RandomMarkdownText(rng, 2000)) };
+    auto& buf = tb.gapBuffer;
+    MoveGapToLogicalIndex(buf, buf.GetContentSize() / 2);
+    tb.RefreshCaches();
+
+    auto layout = LayMarkdownTextRuns({
+        .styles = &gMarkdownStylesheet,
+        .src = &buf,
+        .textRuns = std::span(tb.textRuns),
+        .viewportWidth = 60.0f,
+    });
+    for (auto& gr : layout.glyphRuns) {
+        auto font = gMarkdownStylesheet.LookupFace(gr.tr.style).font;
+        for (int64_t idx = gr.tr.begin; idx <= gr.tr.end; ++idx) {
+            float expected = font->CalcTextSize(font->FontSize, std::numeric_limits<float>::max(), 0.0f, &buf.buffer[gr.tr.begin], &buf.buffer[idx]).x;
+            float got = CalcGlyphRunOffsetX(layout.glyphAdvances, gr, idx);
+            if (got != expected) {
+                fprintf(stderr, "Offset of buffer index %lld in GlyphRun [%d,%d): got %f, expected %f\n", (long long)idx, gr.tr.begin, gr.tr.end, got, expected);
+                return false;
+            }
+            // Right on the left edge of a glyph lands before it
+            if (idx < gr.tr.end && FindGlyphRunIndexAtX(layout.glyphAdvances, gr, got) != idx) {
+                fprintf(stderr, "Hit test at x = %f in GlyphRun [%d,%d) didn't land on buffer index %lld\n", got, gr.tr.begin, gr.tr.end, (long long)idx);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Lay out bullets with LayTextEditsInParallel(), checking that they end up the same as laying them out one by one.
+// Needs SetupLayoutFonts().
+// \return Whether all checks passed.
+bool VerifyParallelLayout() {
+    constexpr float kViewportWidth = 300.0f;
+    TextEditBullets bullets(GenerateText(256 << 10, 5));
+
+    auto requests = bullets.MakeLayoutRequests(kViewportWidth);
+    int numLaidOut = LayTextEditsInParallel(GetWorkerPool(), requests);
+    if (numLaidOut != (int)requests.size()) {
+        fprintf(stderr, "Laid out %d of %zu bullets\n", numLaidOut, requests.size());
+        return false;
+    }
+    // Already up to date, nothing to do
+    numLaidOut = LayTextEditsInParallel(GetWorkerPool(), requests);
+    if (numLaidOut != 0) {
+        fprintf(stderr, "Laid out %d bullets again at the same width\n", numLaidOut);
+        return false;
+    }
+
+    for (size_t i = 0; i < bullets.textEdits.size(); ++i) {
+        auto& te = *bullets.textEdits[i];
+        auto& tb = bullets.buffers[i];
+        auto expected = LayMarkdownTextRuns({
+            .styles = &gMarkdownStylesheet,
+            .src = &tb.gapBuffer,
+            .textRuns = std::span(tb.textRuns),
+            .viewportWidth = kViewportWidth,
+        });
+
+        bool matches = te._cachedGlyphRuns.size() == expected.glyphRuns.size() &&
+                       te._cachedGlyphAdvances == expected.glyphAdvances &&
+                       te._cachedContentHeight == expected.boundingBox.y;
+        for (size_t j = 0; matches && j < expected.glyphRuns.size(); ++j) {
+            auto& a = te._cachedGlyphRuns[j];
+            auto& b = expected.glyphRuns[j];
+            matches = a.tr == b.tr && a.isSoftWrapped == b.isSoftWrapped &&
+                      a.pos.x == b.pos.x && a.pos.y == b.pos.y &&
+                      a.horizontalAdvance == b.horizontalAdvance && a.height == b.height &&
+                      a.advancesBegin == b.advancesBegin;
+        }
+        if (!matches) {
+            fprintf(stderr, "Mismatch in bullet %zu, content:\n%s\n", i, tb.gapBuffer.ExtractContent().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Show bullets nested the way DocumentView shows them, laying them out in parallel beforehand at the width predicted from
+// where each depth began last frame. TextEdit::Show() must then find them up to date, instead of laying them out again.
+// Needs SetupLayoutFonts().
+// \return Whether all checks passed.
+bool VerifyPredictedLayoutWidth() {
+    constexpr int kMaxDepth = 4;
+    TextEditBullets bullets(GenerateText(8 << 10, 11));
+    std::vector<float> offsetsX(kMaxDepth, 0.0f);
+    std::vector<TextEditLayoutRequest> requests;
+
+    auto& io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(800.0f, 600.0f);
+    io.DeltaTime = 1.0f / 60.0f;
+    // The first frame only learns the offsets, the second one lays out at a new window width
+    for (float windowWidth : { 600.0f, 520.0f }) {
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+        ImGui::SetNextWindowSize(ImVec2(windowWidth, 400.0f));
+        ImGui::Begin("Bullets");
+
+        requests.clear();
+        for (size_t i = 0; i < bullets.textEdits.size(); ++i) {
+            requests.push_back({ bullets.textEdits[i].get(), ImGui::GetContentRegionAvailWidthAt(offsetsX[i % kMaxDepth]) });
+        }
+        LayTextEditsInParallel(GetWorkerPool(), requests);
+
+        for (size_t i = 0; i < bullets.textEdits.size(); ++i) {
+            int depth = (int)(i % kMaxDepth);
+            auto window = ImGui::GetCurrentWindow();
+            ImGui::Indent(depth * 20.0f);
+            offsetsX[depth] = window->DC.CursorPos.x - window->Pos.x;
+            bullets.textEdits[i]->Show();
+            ImGui::Unindent(depth * 20.0f);
+        }
+
+        ImGui::End();
+        ImGui::Render();
+    }
+
+    // Anything TextEdit::Show() laid out at a different width than predicted would be laid out again here
+    int numMispredicted = LayTextEditsInParallel(GetWorkerPool(), requests);
+    if (numMispredicted != 0) {
+        fprintf(stderr, "%d of %zu bullets got a different width than predicted\n", numMispredicted, requests.size());
+        return false;
+    }
+    return true;
+}
+
+// How long the main loop sleeps after a frame, with real TextEdit frames providing the requested timeout: forever when
+// idle, until the next caret blink while a TextEdit is active, and until the save when there are unflushed ops. The
+// main loop's save and compaction strategies go off the same deadlines. Needs SetupLayoutFonts().
+// \return Whether all checks passed.
+bool VerifyFrameTimeout() {
+    TextBuffer tb{ GapBuffer(GenerateText(1 << 10, 8)) };
+    tb.RefreshCaches();
+    TextEdit te(ImHashStr("timeout"), tb);
+    MainLoopTimes idle{
+        .currTime = 100.0,
+        .lastEditTime = 20.0,
+        .lastWriteTime = 20.0,
+        .lastCompactionTime = 50.0,
+        .hasUnflushedOps = false,
+    };
+
+    TakeRequestedFrameTimeout();
+    ShowTextEditFrame(te, 0.0f);
+    double timeout = CalcFrameTimeout(TakeRequestedFrameTimeout(), idle);
+    if (!std::isinf(timeout)) {
+        fprintf(stderr, "Idle: waking up after %f s instead of waiting for input\n", timeout);
+        return false;
+    }
+
+    // Same as clicking into it, which NewFrame() keeps since the TextEdit is still shown
+    ImGui::SetActiveID(te._id, ImGui::FindWindowByName("Bullet"));
+    ShowTextEditFrame(te, 0.0f);
+    timeout = CalcFrameTimeout(TakeRequestedFrameTimeout(), idle);
+    ImGui::ClearActiveID();
+    if (!(timeout > 0.0 && timeout <= 1.2)) {
+        fprintf(stderr, "Caret blinking: waking up after %f s\n", timeout);
+        return false;
+    }
+
+    // Edited 0.3 s ago, saved 5 s ago: the save is due 0.7 s from now, then compaction 4.7 s from now
+    MainLoopTimes editing{
+        .currTime = 100.0,
+        .lastEditTime = 99.7,
+        .lastWriteTime = 95.0,
+        .lastCompactionTime = 50.0,
+        .hasUnflushedOps = true,
+    };
+    timeout = CalcFrameTimeout(std::numeric_limits<double>::infinity(), editing);
+    if (std::abs(timeout - 0.7) > 1e-9) {
+        fprintf(stderr, "Unflushed ops: waking up after %f s instead of 0.7 s\n", timeout);
+        return false;
+    }
+    editing.hasUnflushedOps = false;
+    timeout = CalcFrameTimeout(std::numeric_limits<double>::infinity(), editing);
+    if (std::abs(timeout - 4.7) > 1e-9) {
+        fprintf(stderr, "Pending compaction: waking up after %f s instead of 4.7 s\n", timeout);
+        return false;
+    }
+
+    // The main loop after a single edit, sleeping as long as it is told to: one save, one compaction, then nothing is
+    // due until the next edit
+    MainLoopTimes loop{
+        .currTime = 100.0,
+        .lastEditTime = 100.0,
+        .lastWriteTime = 95.0,
+        .lastCompactionTime = 50.0,
+        .hasUnflushedOps = true,
+    };
+    int numSaves = 0;
+    int numCompactions = 0;
+    for (int frame = 0; frame < 10 && !std::isinf(timeout); ++frame) {
+        if (loop.currTime >= CalcNextSaveTime(loop)) {
+            loop.lastWriteTime = loop.currTime;
+            loop.hasUnflushedOps = false;
+            numSaves += 1;
+        }
+        if (loop.currTime >= CalcNextCompactionTime(loop)) {
+            loop.lastCompactionTime = loop.currTime;
+            numCompactions += 1;
+        }
+        timeout = CalcFrameTimeout(std::numeric_limits<double>::infinity(), loop);
+        loop.currTime += ImMax(timeout, 0.0);
+    }
+    if (numSaves != 1 || numCompactions != 1 || !std::isinf(timeout)) {
+        fprintf(stderr, "After an edit: %d saves, %d compactions, then waking up after %f s\n", numSaves, numCompactions, timeout);
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+void IonlBench::RunLayoutBenches(const std::string& content) {
+    BenchLayout(content);
+    BenchCursorOffsets(content);
+    BenchShowTextEdit(content);
+    BenchRelayoutBullets(content);
+    BenchTextBufferTypingWithLayout(content);
+}
+
+bool IonlBench::RunLayoutChecks(bool quick) {
+    bool passed = ReportCheck("Incremental relayout", VerifyIncrementalRelayout(quick ? 2000 : 50000));
+    passed &= ReportCheck("Glyph advances", VerifyGlyphAdvances());
+    passed &= ReportCheck("Parallel layout", VerifyParallelLayout());
+    passed &= ReportCheck("Predicted layout width", VerifyPredictedLayoutWidth());
+    passed &= ReportCheck("Frame timeout", VerifyFrameTimeout());
+    return passed;
+}
@@ -0,0 +1,88 @@
+// Microbenchmarks for the text data structures (GapBuffer, TextBuffer), runnable without a window.
+//
+// Usage: IonlBench [--quick] [--filter <substring>] [--out <file.json>] [--threads <n>] [--verify]
+//
+// Each workload is run on several content sizes, and repeated until enough time has been measured. Results are written
+// as JSON (to stdout by default), one entry per (workload, backend, size), so that runs can be diffed or plotted.
+//
+// --threads sets the size of the WorkerPool for the parallel workloads (bulk parsing and layout), which otherwise
+// leaves one hardware thread for the UI thread like the app does.
+//
+// --verify skips the benchmarks, and instead checks that the incremental algorithms being benchmarked give the same
+// results as their from-scratch counterparts.
+// The workloads and checks live in one file per area: text_storage.cpp, parsing.cpp and layout.cpp, on top of the
+// shared fixture in bench.hpp.
+
+#include "bench.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace IonlBench;
+
+int main(int argc, char** argv) {
+    bool quick = false;
+    bool verify = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = true;
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            gOptions.filter = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            gOptions.outPath = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            gOptions.threads = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--quick] [--filter <substring>] [--out <file.json>] [--threads <n>] [--verify]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (verify) {
+        SetupLayoutFonts();
+        bool passed = RunTextStorageChecks(quick);
+        passed &= RunParsingChecks(quick);
+        passed &= RunLayoutChecks(quick);
+        return passed ? 0 : 1;
+    }
+    if (quick) {
+        gOptions.minTotalSeconds = 0.0;
+        gOptions.minRuns = 1;
+    }
+
+    std::vector<int64_t> sizes{ 1 << 10, 64 << 10, 1 << 20, 10 << 20 };
+    if (quick) {
+        sizes = { 1 << 10, 64 << 10 };
+    }
+
+    SetupLayoutFonts();
+
+    std::string clipboard = GenerateText(256 << 10, 2);
+    for (int64_t size : sizes) {
+        std::string content = GenerateText(size, 1);
+        RunTextStorageBenches(content, clipboard);
+        RunParsingBenches(content);
+        RunLayoutBenches(content);
+    }
+
+    FILE* out = stdout;
+    if (gOptions.outPath) {
+        out = fopen(gOptions.outPath, "w");
+        if (!out) {
+            fprintf(stderr, "Failed to open %s for writing\n", gOptions.outPath);
+            return 1;
+        }
+    }
+    WriteResults(out);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
+
@@ -0,0 +1,291 @@
+// Workloads on Markdown parsing: from scratch, incrementally while typing, in bulk on a WorkerPool, and from cached
+// TextRun's.
+
+#include "bench.hpp"
+
+#include <ionl/bulk_parse.hpp>
+#include <ionl/gap_buffer.hpp>
+#include <ionl/markdown.hpp>
+#include <ionl/text_buffer.hpp>
+#include <ionl/undo_journal.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace Ionl;
+using namespace IonlBench;
+
+namespace {
+void BenchBulkParse(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    auto lines = SplitLines(content);
+    auto numLines = (int64_t)lines.size();
+
+    // Same as loading a subtree: packed bullets fetched from the database, turned into TextBuffer's and parsed
+    auto noState = []() { return 0; };
+    Bench("bulk_parse", "serial", contentBytes, numLines, contentBytes, noState, [&](int) {
+        std::vector<TextBuffer> buffers;
+        buffers.reserve(lines.size());
+        for (auto line : lines) {
+            buffers.emplace_back(GapBuffer(line, /*packed*/ true));
+        }
+        gSink = (int64_t)buffers.back().textRuns.size();
+    });
+
+    auto backend = "WorkerPool/" + std::to_string(GetWorkerPool().GetThreadCount()) + "threads";
+    Bench("bulk_parse", backend, contentBytes, numLines, contentBytes, noState, [&](int) {
+        std::vector<TextBuffer> buffers;
+        std::vector<TextBuffer*> pointers;
+        buffers.reserve(lines.size());
+        for (auto line : lines) {
+            pointers.push_back(&buffers.emplace_back(GapBuffer(line, /*packed*/ true), kDefaultUndoJournalByteLimit, /*deferParse*/ true));
+        }
+
+        BulkMarkdownParser parser(GetWorkerPool());
+        parser.Submit(pointers);
+        parser.WaitAndPublishResults();
+        gSink = (int64_t)buffers.back().textRuns.size();
+    });
+}
+
+void BenchLoadTextRuns(const std::string& content) {
+    if (!IsWorkloadSelected("load_text_runs", "parse") && !IsWorkloadSelected("load_text_runs", "cached")) {
+        return;
+    }
+
+    auto contentBytes = (int64_t)content.size();
+    auto lines = SplitLines(content);
+    auto numLines = (int64_t)lines.size();
+
+    // What the database would hold for each bullet, see IBackingStore::StoreCachedTextRuns()
+    std::vector<std::vector<uint8_t>> serialized(lines.size());
+    int64_t serializedBytes = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        TextBuffer tb{ GapBuffer(lines[i], /*packed*/ true) };
+        SerializeTextRuns(tb.logicalTextRuns, serialized[i]);
+        serializedBytes += (int64_t)serialized[i].size();
+    }
+    fprintf(stderr, "load_text_runs: %lld B of text, %lld B of serialized TextRun's\n", (long long)contentBytes, (long long)serializedBytes);
+
+    auto noState = []() { return 0; };
+    Bench("load_text_runs", "parse", contentBytes, numLines, contentBytes, noState, [&](int) {
+        std::vector<TextBuffer> buffers;
+        buffers.reserve(lines.size());
+        for (auto line : lines) {
+            buffers.emplace_back(GapBuffer(line, /*packed*/ true));
+        }
+        gSink = (int64_t)buffers.back().textRuns.size();
+    });
+
+    Bench("load_text_runs", "cached", contentBytes, numLines, contentBytes, noState, [&](int) {
+        std::vector<TextBuffer> buffers;
+        std::vector<TextRun> runs;
+        buffers.reserve(lines.size());
+        for (size_t i = 0; i < lines.size(); ++i) {
+            GapBuffer buf(lines[i], /*packed*/ true);
+            DeserializeTextRuns(serialized[i], buf.GetContentSize(), runs);
+            buffers.emplace_back(std::move(buf), std::move(runs));
+        }
+        gSink = (int64_t)buffers.back().textRuns.size();
+    });
+}
+
+void BenchTextBufferTyping(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    constexpr int64_t kKeystrokes = 200;
+    constexpr std::string_view kTyped = "some **bold** text\n";
+
+    // Same as what TextEdit does per keystroke: edit, then refresh the parsed TextRun's
+    Bench(
+        "typing_with_reparse", "TextBuffer", contentBytes, kKeystrokes, 0,
+        [&]() {
+            TextBuffer tb{ GapBuffer(content) };
+            MoveGapToLogicalIndex(tb.gapBuffer, tb.gapBuffer.GetContentSize() / 2);
+            return tb;
+        },
+        [&](TextBuffer& tb) {
+            for (int64_t i = 0; i < kKeystrokes; ++i) {
+                char c = kTyped[i % kTyped.size()];
+                InsertAtGap(tb.gapBuffer, &c, 1);
+                tb.RefreshCaches();
+            }
+            gSink = (int64_t)tb.textRuns.size();
+        });
+}
+
+void BenchMarkdownParse(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    int64_t count = ScaleOps(contentBytes, 16 << 20, 1, 1000);
+
+    GapBuffer buf(content);
+    MoveGapToLogicalIndex(buf, buf.GetContentSize() / 2);
+
+    Bench(
+        "markdown_parse", "GapBuffer", contentBytes, count, count * contentBytes,
+        []() { return 0; },
+        [&](int) {
+            for (int64_t i = 0; i < count; ++i) {
+                gSink = (int64_t)ParseMarkdownBuffer(buf).size();
+            }
+        });
+}
+
+// Delimiter-heavy content that defeats the plain text skipping, like pasted code or logs
+void BenchMarkdownParsePathological(int64_t contentBytes) {
+    struct Input {
+        const char* name;
+        std::string_view pattern;
+    };
+    static constexpr Input kInputs[] = {
+        { "lone_asterisks", "*" },
+        { "lone_backticks", "`" },
+        { "unmatched_mixed", "*_`~~**__" },
+        { "escapes", "\\*\\_\\`" },
+        { "log_lines", "[12:00:01] ERR some_var*2 `x` ~~__ptr\n" },
+    };
+
+    int64_t count = ScaleOps(contentBytes, 16 << 20, 1, 1000);
+    for (const auto& input : kInputs) {
+        std::string content;
+        content.reserve(contentBytes + input.pattern.size());
+        while ((int64_t)content.size() < contentBytes) {
+            content += input.pattern;
+        }
+        content.resize(contentBytes);
+
+        GapBuffer buf(content);
+        Bench(
+            "markdown_parse_pathological", input.name, contentBytes, count, count * contentBytes,
+            []() { return 0; },
+            [&](int) {
+                for (int64_t i = 0; i < count; ++i) {
+                    gSink = (int64_t)ParseMarkdownBuffer(buf).size();
+                }
+            });
+    }
+}
+
+// Random edit session on a TextBuffer, checking after every RefreshCaches() that the incrementally updated TextRun's
+// are identical to parsing everything from scratch.
+// \return Whether all checks passed.
+bool VerifyIncrementalReparse(int64_t numSteps) {
+    std::mt19937 rng(42);
+    TextBuffer tb{ GapBuffer(RandomMarkdownText(rng, 200)) };
+    auto& buf = tb.gapBuffer;
+    for (int64_t step = 0; step < numSteps; ++step) {
+        DoRandomEdits(buf, rng);
+        tb.RefreshCaches();
+
+        auto expected = ParseMarkdownBuffer(buf);
+        if (tb.textRuns != expected) {
+            fprintf(stderr, "Mismatch at step %lld: got %zu TextRun's, expected %zu, content:\n%s\n", (long long)step, tb.textRuns.size(), expected.size(), buf.ExtractContent().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Type into a TextBuffer the way TextEdit does, checking that refreshing the caches doesn't allocate once it has warmed
+// up. Edits themselves may still allocate now and then, e.g. when the undo journal grows.
+// \return Whether all checks passed.
+bool VerifyAllocationFreeTyping() {
+    TextBuffer tb{ GapBuffer(GenerateText(64 << 10, 1)) };
+    MoveGapToLogicalIndex(tb.gapBuffer, tb.gapBuffer.GetContentSize() / 2);
+
+    constexpr std::string_view kTyped = "plain words typed one by one ";
+    auto type = [&](int64_t numKeystrokes) {
+        int64_t allocations = 0;
+        for (int64_t i = 0; i < numKeystrokes; ++i) {
+            char c = kTyped[i % kTyped.size()];
+            InsertAtGap(tb.gapBuffer, &c, 1);
+
+            int64_t allocationsBegin = gAllocationCount;
+            tb.RefreshCaches();
+            allocations += gAllocationCount - allocationsBegin;
+        }
+        return allocations;
+    };
+
+    // Warm up
+    type(100);
+    int64_t allocations = type(1000);
+    if (allocations != 0) {
+        fprintf(stderr, "RefreshCaches() made %lld allocations in 1000 keystrokes\n", (long long)allocations);
+        return false;
+    }
+    return true;
+}
+
+// Parse bullets with BulkMarkdownParser while editing some of them before the results get published, checking that
+// they end up the same as parsing them one by one.
+// \return Whether all checks passed.
+bool VerifyBulkParse() {
+    auto content = GenerateText(256 << 10, 3);
+    auto lines = SplitLines(content);
+
+    std::vector<TextBuffer> buffers;
+    std::vector<TextBuffer*> pointers;
+    buffers.reserve(lines.size());
+    for (auto line : lines) {
+        pointers.push_back(&buffers.emplace_back(GapBuffer(line, /*packed*/ true), kDefaultUndoJournalByteLimit, /*deferParse*/ true));
+    }
+
+    BulkMarkdownParser parser(GetWorkerPool());
+    parser.Submit(pointers);
+
+    std::mt19937 rng(4);
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        auto& tb = buffers[i];
+        switch (i % 4) {
+            // Edited after submitting, the result must get the edit reparsed on top
+            case 0: {
+                MoveGapToLogicalIndex(tb.gapBuffer, rng() % (tb.gapBuffer.GetContentSize() + 1));
+                InsertAtGap(tb.gapBuffer, "**x_", 4);
+            } break;
+            // Refreshed (and therefore fully parsed) before the result arrives, the result must get discarded
+            case 1: tb.RefreshCaches(); break;
+            // Cancelled, the result must get dropped
+            case 2: parser.Cancel(tb); break;
+            default: break;
+        }
+    }
+    parser.WaitAndPublishResults();
+
+    for (size_t i = 0; i < buffers.size(); ++i) {
+        auto& tb = buffers[i];
+        if (tb.parsedContentSize == -1) {
+            // Only the cancelled ones are left unparsed
+            if (i % 4 != 2) {
+                fprintf(stderr, "Bullet %zu never got parsed\n", i);
+                return false;
+            }
+            tb.RefreshCaches();
+        }
+
+        auto expected = ParseMarkdownBuffer(tb.gapBuffer);
+        if (tb.textRuns != expected) {
+            fprintf(stderr, "Mismatch in bullet %zu, content:\n%s\n", i, tb.gapBuffer.ExtractContent().c_str());
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+void IonlBench::RunParsingBenches(const std::string& content) {
+    BenchMarkdownParse(content);
+    BenchMarkdownParsePathological((int64_t)content.size());
+    BenchBulkParse(content);
+    BenchLoadTextRuns(content);
+    BenchTextBufferTyping(content);
+}
+
+bool IonlBench::RunParsingChecks(bool quick) {
+    bool passed = ReportCheck("Incremental reparse", VerifyIncrementalReparse(quick ? 2000 : 50000));
+    passed &= ReportCheck("Allocation-free typing", VerifyAllocationFreeTyping());
+    passed &= ReportCheck("Bulk parse", VerifyBulkParse());
+    return passed;
+}
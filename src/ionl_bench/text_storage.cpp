@@ -0,0 +1,517 @@
+// Workloads on the text storage itself: GapBuffer editing, search and replace, UTF-8 transcoding.
+
+#include "bench.hpp"
+
+#include <ionl/gap_buffer.hpp>
+#include <ionl/text_buffer.hpp>
+#include <ionl/text_search.hpp>
+#include <ionl/undo_journal.hpp>
+#include <ionl/utf8.hpp>
+#include <ionl/widget_text_edit.hpp>
+
+#include <imgui/imgui_internal.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace Ionl;
+using namespace IonlBench;
+
+namespace {
+void BenchTyping(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    constexpr int64_t kKeystrokes = 10000;
+    constexpr std::string_view kTyped = "the quick brown fox jumps over the lazy dog\n";
+
+    Bench(
+        "typing", "GapBuffer", contentBytes, kKeystrokes, 0,
+        [&]() {
+            GapBuffer text(content);
+            MoveGapToLogicalIndex(text, text.GetContentSize() / 2);
+            return text;
+        },
+        [&](GapBuffer& text) {
+            for (int64_t i = 0; i < kKeystrokes; ++i) {
+                char c = kTyped[i % kTyped.size()];
+                InsertAtGap(text, &c, 1);
+            }
+            gSink = text.GetContentSize();
+        });
+}
+
+void BenchCaretJumps(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    int64_t jumps = ScaleOps(contentBytes, 256 << 20, 20, 2000);
+
+    Bench(
+        "caret_jumps", "GapBuffer", contentBytes, jumps, 0,
+        [&]() { return GapBuffer(content); },
+        [&](GapBuffer& text) {
+            std::mt19937 rng(42);
+            for (int64_t i = 0; i < jumps; ++i) {
+                MoveGapToLogicalIndex(text, rng() % (text.GetContentSize() + 1));
+                InsertAtGap(text, "x", 1);
+            }
+            gSink = text.GetContentSize();
+        });
+}
+
+void BenchBackspaceStorm(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    int64_t count = std::min<int64_t>(10000, contentBytes / 2);
+
+    Bench(
+        "backspace_storm", "GapBuffer", contentBytes, count, 0,
+        [&]() {
+            GapBuffer text(content);
+            MoveGapToLogicalIndex(text, text.GetContentSize() * 3 / 4);
+            return text;
+        },
+        [&](GapBuffer& text) {
+            for (int64_t i = 0; i < count; ++i) {
+                DeleteFromGap(text, -1);
+            }
+            gSink = text.GetContentSize();
+        });
+}
+
+void BenchLargePaste(const std::string& content, const std::string& clipboard) {
+    auto contentBytes = (int64_t)content.size();
+    constexpr int64_t kPastes = 8;
+
+    Bench(
+        "large_paste", "GapBuffer", contentBytes, kPastes, kPastes * (int64_t)clipboard.size(),
+        [&]() { return GapBuffer(content); },
+        [&](GapBuffer& text) {
+            std::mt19937 rng(7);
+            for (int64_t i = 0; i < kPastes; ++i) {
+                MoveGapToLogicalIndex(text, rng() % (text.GetContentSize() + 1));
+                InsertAtGap(text, clipboard.data(), clipboard.size());
+            }
+            gSink = text.GetContentSize();
+        });
+}
+
+void BenchRoundTrip(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    int64_t count = ScaleOps(contentBytes, 64 << 20, 1, 1000);
+
+    Bench(
+        "update_extract_roundtrip", "GapBuffer", contentBytes, count, count * contentBytes * 2,
+        [&]() { return GapBuffer(); },
+        [&](GapBuffer& text) {
+            std::string out;
+            for (int64_t i = 0; i < count; ++i) {
+                text.UpdateContent(content);
+                text.ExtractContent(out);
+                gSink = (int64_t)out.size();
+            }
+        });
+}
+
+void BenchReplaceAll(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    SearchPattern pattern("the");
+    std::vector<ImWchar> replacement{ 'T', 'H', 'E', '!' };
+
+    std::vector<int64_t> matches;
+    FindAllMatches(GapBuffer(content), pattern, matches);
+    auto numMatches = (int64_t)matches.size();
+    auto matchSize = (int64_t)pattern.text.size();
+
+    // Same as what TextEdit::ReplaceAll() starts from: a buffer with undo history, the gap wherever the caret was.
+    // "sequential" is what it does, "ApplyEdits" is the batched alternative.
+    auto setup = [&]() {
+        GapBuffer buf(content);
+        buf.undoJournal = std::make_unique<UndoJournal>(kDefaultUndoJournalByteLimit);
+        MoveGapToLogicalIndex(buf, buf.GetContentSize() / 2);
+        return buf;
+    };
+    Bench("replace_all", "sequential", contentBytes, numMatches, contentBytes, setup, [&](GapBuffer& buf) {
+        buf.undoJournal->BeginGroup();
+        // Back to front, so that the indices of the matches not yet replaced stay valid
+        for (size_t i = matches.size(); i-- > 0;) {
+            MoveGapToLogicalIndex(buf, matches[i] + matchSize);
+            DeleteFromGap(buf, -matchSize);
+            InsertAtGap(buf, replacement.data(), replacement.size());
+        }
+        buf.undoJournal->EndGroup();
+        gSink = buf.GetContentSize();
+    });
+    Bench("replace_all", "ApplyEdits", contentBytes, numMatches, contentBytes, setup, [&](GapBuffer& buf) {
+        std::vector<GapBufferEdit> edits;
+        edits.reserve(matches.size());
+        for (int64_t idx : matches) {
+            edits.push_back({ .begin = idx, .end = idx + matchSize, .text = replacement.data(), .textSize = replacement.size() });
+        }
+        ApplyEdits(buf, edits);
+        gSink = buf.GetContentSize();
+    });
+}
+
+void BenchTranscoding(const std::string& content) {
+    auto contentBytes = (int64_t)content.size();
+    int64_t count = ScaleOps(contentBytes, 64 << 20, 1, 1000);
+
+    std::vector<ImWchar> decoded(content.size() + 1);
+    int64_t numCodepoints = Utf8CountCodepoints(content.data(), content.data() + content.size());
+    Utf8Decode(decoded.data(), (int64_t)decoded.size(), content.data(), content.data() + content.size());
+    std::string encoded(content.size() * 3 + 1, '\0');
+
+    auto noState = []() { return 0; };
+    // ImGui's routines take int sizes
+    bool fitsInt = contentBytes * 3 < INT32_MAX;
+
+    Bench("utf8_decode", GetUtf8KernelName(), contentBytes, count, count * contentBytes, noState, [&](int) {
+        for (int64_t i = 0; i < count; ++i) {
+            gSink = Utf8Decode(decoded.data(), (int64_t)decoded.size(), content.data(), content.data() + content.size());
+        }
+    });
+    Bench("utf8_encode", GetUtf8KernelName(), contentBytes, count, count * contentBytes, noState, [&](int) {
+        for (int64_t i = 0; i < count; ++i) {
+            gSink = Utf8Encode(encoded.data(), decoded.data(), decoded.data() + numCodepoints);
+        }
+    });
+    if (fitsInt) {
+        Bench("utf8_decode", "imgui", contentBytes, count, count * contentBytes, noState, [&](int) {
+            for (int64_t i = 0; i < count; ++i) {
+                gSink = ImTextStrFromUtf8NoNullTerminate(decoded.data(), (int)decoded.size(), content.data(), content.data() + content.size());
+            }
+        });
+        Bench("utf8_encode", "imgui", contentBytes, count, count * contentBytes, noState, [&](int) {
+            for (int64_t i = 0; i < count; ++i) {
+                gSink = ImTextStrToUtf8(encoded.data(), (int)encoded.size(), decoded.data(), decoded.data() + numCodepoints);
+            }
+        });
+    }
+}
+
+// Run the UTF-8 kernels selected for this CPU against their ImGui counterparts, on random mixes of ASCII runs (long
+// enough for the vector loops), 2-4 byte sequences and invalid or truncated UTF-8, at every alignment.
+// \return Whether all checks passed.
+bool VerifyUtf8Kernels() {
+    static constexpr std::string_view kPieces[] = {
+        "\xC3\xA9", "\xE6\x97\xA5", "\xF0\x9F\x98\x80", "\xEF\xBF\xBD", // 2-4 bytes, U+FFFD itself
+        "\x80", "\xBF", "\xFF", "\xC0\xAF", "\xED\xA0\x80", "\xF4\x90\x80\x80", // Invalid
+        "\xC3", "\xE6\x97", "\xF0\x9F\x98", // Truncated
+    };
+    constexpr int kPieceCount = sizeof(kPieces) / sizeof(kPieces[0]);
+
+    std::mt19937 rng(10);
+    std::string text;
+    std::vector<ImWchar> ours;
+    std::vector<ImWchar> theirs;
+    std::string oursUtf8;
+    std::string theirsUtf8;
+    for (int iteration = 0; iteration < 2000; ++iteration) {
+        text.assign(rng() % 32, 'a'); // Shifts everything after it to a different alignment
+        while (text.size() < 200) {
+            if (rng() % 2) {
+                auto runLength = rng() % 70;
+                for (uint32_t i = 0; i < runLength; ++i) {
+                    text += (char)(' ' + rng() % 95);
+                }
+            } else {
+                text += kPieces[rng() % kPieceCount];
+            }
+        }
+        // Cut anywhere, including in the middle of a sequence
+        auto begin = text.data();
+        auto end = text.data() + rng() % (text.size() + 1);
+
+        int64_t ourCount = Utf8CountCodepoints(begin, end);
+        int64_t theirCount = ImTextCountCharsFromUtf8(begin, end);
+        ours.assign(text.size() + 1, 0);
+        theirs.assign(text.size() + 1, 0);
+        const char* ourRemaining;
+        const char* theirRemaining;
+        int64_t ourDecoded = Utf8Decode(ours.data(), (int64_t)ours.size(), begin, end, &ourRemaining);
+        int64_t theirDecoded = ImTextStrFromUtf8NoNullTerminate(theirs.data(), (int)theirs.size(), begin, end, &theirRemaining);
+        if (ourCount != theirCount || ourDecoded != theirDecoded || ourRemaining != theirRemaining ||
+            !std::equal(ours.begin(), ours.begin() + ourDecoded, theirs.begin()))
+        {
+            fprintf(stderr, "Iteration %d: counted %lld vs %lld, decoded %lld vs %lld codepoints, or they differ\n", iteration, (long long)ourCount, (long long)theirCount, (long long)ourDecoded, (long long)theirDecoded);
+            return false;
+        }
+
+        // Anything but 0 can be encoded, including unpaired surrogates
+        for (int i = 0; i < 8 && ourDecoded > 0; ++i) {
+            ours[rng() % ourDecoded] = (ImWchar)(1 + rng() % 0xFFFF);
+        }
+        auto wideBegin = ours.data();
+        auto wideEnd = ours.data() + ourDecoded;
+        int64_t ourBytes = Utf8CountBytes(wideBegin, wideEnd);
+        int64_t theirBytes = ImTextCountUtf8BytesFromStr(wideBegin, wideEnd);
+        oursUtf8.assign(ourBytes, '\0');
+        theirsUtf8.assign(theirBytes + 1, '\0');
+        int64_t ourEncoded = Utf8Encode(oursUtf8.data(), wideBegin, wideEnd);
+        int64_t theirEncoded = ImTextStrToUtf8(theirsUtf8.data(), (int)theirsUtf8.size(), wideBegin, wideEnd);
+        theirsUtf8.resize(theirEncoded);
+        if (ourBytes != theirBytes || ourEncoded != theirEncoded || oursUtf8 != theirsUtf8) {
+            fprintf(stderr, "Iteration %d: counted %lld vs %lld bytes, encoded %lld vs %lld bytes, or they differ\n", iteration, (long long)ourBytes, (long long)theirBytes, (long long)ourEncoded, (long long)theirEncoded);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Replace all matches in a TextEdit, checking the text against std::string, where the cursor and anchor end up, and that
+// the whole replacement is undone and redone in a single step. Needs SetupLayoutFonts().
+// \return Whether all checks passed.
+bool VerifyReplaceAll() {
+    auto content = GenerateText(64 << 10, 6);
+    TextBuffer tb{ GapBuffer(content) };
+    tb.RefreshCaches();
+    TextEdit te(ImHashStr("replace"), tb);
+
+    constexpr std::string_view kPattern = "the";
+    constexpr std::string_view kReplacement = "THE!";
+    std::string expected = content;
+    std::vector<size_t> matches;
+    for (size_t pos = 0; (pos = expected.find(kPattern, pos)) != std::string::npos; pos += kPattern.size()) {
+        matches.push_back(pos);
+    }
+    for (size_t i = matches.size(); i-- > 0;) {
+        expected.replace(matches[i], kPattern.size(), kReplacement);
+    }
+    if (matches.size() < 2) {
+        fprintf(stderr, "Generated text has too few matches\n");
+        return false;
+    }
+    auto match = Utf8CountCodepoints(content.data(), content.data() + matches[matches.size() / 2]);
+    auto growth = (int64_t)(kReplacement.size() - kPattern.size());
+    // Inside a match, and right after one. Set directly, since nothing has been laid out for SetCursor() to refresh.
+    te._cursorIdx = match + 1;
+    te._anchorIdx = match + (int64_t)kPattern.size();
+    int64_t expectedCursor = match + (int64_t)(matches.size() / 2) * growth + (int64_t)kReplacement.size();
+    int64_t expectedAnchor = expectedCursor;
+
+    int64_t numReplaced = te.ReplaceAll(SearchPattern(kPattern), kReplacement);
+    if (numReplaced != (int64_t)matches.size() || tb.gapBuffer.ExtractContent() != expected) {
+        fprintf(stderr, "Replaced %lld of %zu matches, or the text doesn't match\n", (long long)numReplaced, matches.size());
+        return false;
+    }
+    if (te._cursorIdx != expectedCursor || te._anchorIdx != expectedAnchor) {
+        fprintf(stderr, "Cursor at %lld, anchor at %lld, expected both at %lld\n", (long long)te._cursorIdx, (long long)te._anchorIdx, (long long)expectedCursor);
+        return false;
+    }
+
+    auto& journal = *tb.gapBuffer.undoJournal;
+    Undo(journal, tb.gapBuffer);
+    if (tb.gapBuffer.ExtractContent() != content || journal.CanUndo()) {
+        fprintf(stderr, "A single Undo() didn't restore the original text\n");
+        return false;
+    }
+    Redo(journal, tb.gapBuffer);
+    if (tb.gapBuffer.ExtractContent() != expected) {
+        fprintf(stderr, "Redo() didn't reapply the replacement\n");
+        return false;
+    }
+    return true;
+}
+
+// Undo and redo ApplyEdits() calls where some of the edits are no-ops, which must still be undone in a single step of
+// their own, after typing that must stay a separate step.
+// \return Whether all checks passed.
+bool VerifyApplyEditsUndo() {
+    std::vector<ImWchar> x{ 'X' };
+    std::vector<ImWchar> typed{ '!', '!' };
+    for (bool typeFirst : { false, true }) {
+        GapBuffer buf("hello world");
+        buf.undoJournal = std::make_unique<UndoJournal>(kDefaultUndoJournalByteLimit);
+        auto& journal = *buf.undoJournal;
+        std::string original = "hello world";
+        if (typeFirst) {
+            MoveGapToLogicalIndex(buf, buf.GetContentSize());
+            InsertAtGap(buf, typed.data(), typed.size());
+            original += "!!";
+        }
+
+        // Leading, trailing and in-between no-ops
+        GapBufferEdit edits[] = {
+            { .begin = 0, .end = 0 },
+            { .begin = 0, .end = 1, .text = x.data(), .textSize = x.size() },
+            { .begin = 3, .end = 3 },
+            { .begin = 6, .end = 11, .text = x.data(), .textSize = x.size() },
+            { .begin = 11, .end = 11 },
+        };
+        ApplyEdits(buf, edits);
+        std::string edited = typeFirst ? "Xello X!!" : "Xello X";
+        if (buf.ExtractContent() != edited) {
+            fprintf(stderr, "ApplyEdits() gave \"%s\"\n", buf.ExtractContent().c_str());
+            return false;
+        }
+
+        Undo(journal, buf);
+        if (buf.ExtractContent() != original || journal.CanUndo() != typeFirst) {
+            fprintf(stderr, "Undo() gave \"%s\", expected \"%s\"\n", buf.ExtractContent().c_str(), original.c_str());
+            return false;
+        }
+        Redo(journal, buf);
+        if (buf.ExtractContent() != edited || journal.CanRedo()) {
+            fprintf(stderr, "Redo() gave \"%s\", expected \"%s\"\n", buf.ExtractContent().c_str(), edited.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Widen and shrink the gap of buffers on both sides of kGapGrowthTaperThreshold, with and without a snapshot sharing the
+// storage, checking that the content survives and that WidenGap() never leaves a smaller gap than it was asked for or
+// had before.
+// \return Whether all checks passed.
+bool VerifyWidenShrinkGap() {
+    for (int64_t contentBytes : { (int64_t)1000, (int64_t)64 << 10 }) {
+        for (bool withSnapshot : { false, true }) {
+            auto content = GenerateText(contentBytes, 8);
+            GapBuffer buf(content);
+            MoveGapToLogicalIndex(buf, buf.GetContentSize() / 2);
+            std::shared_ptr<const GapBuffer> snapshot;
+            if (withSnapshot) {
+                snapshot = TakeSnapshot(buf);
+            }
+
+            // Requests both above and below the current gap size, the last one after the gap got much wider than needed
+            int64_t contentSize = buf.GetContentSize();
+            for (int64_t requested : { (int64_t)0, (int64_t)1, contentSize / 4, contentSize * 2, (int64_t)1 }) {
+                int64_t oldGapSize = buf.GetGapSize();
+                WidenGap(buf, (size_t)requested);
+                if (buf.GetGapSize() < ImMax(requested, oldGapSize) || buf.ExtractContent() != content) {
+                    fprintf(stderr, "WidenGap(%lld) on %lld bytes: gap %lld -> %lld, or the text doesn't match\n", (long long)requested, (long long)contentBytes, (long long)oldGapSize, (long long)buf.GetGapSize());
+                    return false;
+                }
+            }
+
+            // Widening detached the storage from the snapshot, so shrinking goes ahead either way
+            int64_t trimmedBytes = ShrinkGapToFit(buf);
+            if (trimmedBytes <= 0 || buf.GetGapSize() > kMinimumGapBufferSize || buf.ExtractContent() != content) {
+                fprintf(stderr, "ShrinkGapToFit() on %lld bytes trimmed %lld bytes and left a gap of %lld, or the text doesn't match\n", (long long)contentBytes, (long long)trimmedBytes, (long long)buf.GetGapSize());
+                return false;
+            }
+            WidenGap(buf, 1);
+            if (buf.GetGapSize() < 1 || buf.ExtractContent() != content || (snapshot && snapshot->ExtractContent() != content)) {
+                fprintf(stderr, "WidenGap() after ShrinkGapToFit() on %lld bytes left the wrong text\n", (long long)contentBytes);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Unpack and repack text, which must come back the same, unless it has characters that unpacking would lose. Those are
+// flagged by CanUnpack() instead, while a U+FFFD that is actually part of the text isn't.
+// \return Whether all checks passed.
+bool VerifyPackUnpack() {
+    auto generated = GenerateText(4 << 10, 9);
+    struct Case {
+        std::string text;
+        bool canUnpack;
+    };
+    Case cases[] = {
+        { "plain ascii", true },
+        { generated, true },
+        { generated + "\uFFFD", true },
+        { generated + "\U0001F600", false },
+        { "\U0001F600" + generated, false },
+        { generated + "\xFF", false },
+        { generated + "\xE6\x97", false },
+    };
+    for (auto& c : cases) {
+        // As fetched from the backing store
+        GapBuffer buf(c.text, /*packed*/ true);
+        if (buf.CanUnpack() != c.canUnpack || buf.ExtractContent() != c.text) {
+            fprintf(stderr, "Case %zu: CanUnpack() is %d, or the packed text doesn't match\n", &c - cases, (int)buf.CanUnpack());
+            return false;
+        }
+        if (!c.canUnpack) {
+            continue;
+        }
+        buf.Unpack();
+        MoveGapToLogicalIndex(buf, buf.GetContentSize() / 2);
+        if (buf.IsPacked() || buf.ExtractContent() != c.text) {
+            fprintf(stderr, "Case %zu: unpacked text doesn't match\n", &c - cases);
+            return false;
+        }
+        buf.Pack();
+        if (!buf.CanUnpack() || buf.ExtractContent() != c.text) {
+            fprintf(stderr, "Case %zu: repacked text doesn't match\n", &c - cases);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Search the same text packed and unpacked (with the gap in the middle), which must find the same matches, also with
+// characters outside the BMP and U+FFFD on either side.
+// \return Whether all checks passed.
+bool VerifySearchPackedUnpacked() {
+    auto generated = GenerateText(64 << 10, 7);
+    std::string content;
+    int wordCount = 0;
+    for (char c : generated) {
+        content += c;
+        if (c == ' ' && ++wordCount % 7 == 0) {
+            content += wordCount % 2 ? "\U0001F600 " : "\uFFFD ";
+        }
+    }
+
+    GapBuffer packed(content, /*packed*/ true);
+    GapBuffer unpacked(content);
+    MoveGapToLogicalIndex(unpacked, unpacked.GetContentSize() / 2);
+
+    struct Query {
+        std::string_view text;
+        bool caseInsensitive;
+        // Whether anything should be found, so that two empty results don't pass by accident
+        bool expectMatches;
+    };
+    constexpr Query kQueries[] = {
+        { "the", false, true },
+        { "THE", true, true },
+        { "caf\u00E9", false, true },
+        { "\u65E5\u672C", false, true },
+        { "\U0001F600", false, false },
+        { "\uFFFD", false, false },
+        { "the \U0001F600", false, false },
+        { "\xFF", false, false },
+    };
+    std::vector<int64_t> packedMatches;
+    std::vector<int64_t> unpackedMatches;
+    for (auto& query : kQueries) {
+        SearchPattern pattern(query.text, query.caseInsensitive);
+        packedMatches.clear();
+        unpackedMatches.clear();
+        FindAllMatches(packed, pattern, packedMatches);
+        FindAllMatches(unpacked, pattern, unpackedMatches);
+        if (packedMatches != unpackedMatches || packedMatches.empty() == query.expectMatches) {
+            fprintf(stderr, "Query %zu: %zu matches packed, %zu unpacked\n", &query - kQueries, packedMatches.size(), unpackedMatches.size());
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+void IonlBench::RunTextStorageBenches(const std::string& content, const std::string& clipboard) {
+    BenchTyping(content);
+    BenchCaretJumps(content);
+    BenchBackspaceStorm(content);
+    BenchLargePaste(content, clipboard);
+    BenchRoundTrip(content);
+    BenchReplaceAll(content);
+    BenchTranscoding(content);
+}
+
+bool IonlBench::RunTextStorageChecks(bool quick) {
+    (void)quick;
+    bool passed = ReportCheck("UTF-8 kernels", VerifyUtf8Kernels());
+    passed &= ReportCheck("Replace all", VerifyReplaceAll());
+    passed &= ReportCheck("Search packed/unpacked", VerifySearchPackedUnpacked());
+    passed &= ReportCheck("Pack/unpack", VerifyPackUnpack());
+    passed &= ReportCheck("Widen/shrink gap", VerifyWidenShrinkGap());
+    passed &= ReportCheck("ApplyEdits undo", VerifyApplyEditsUndo());
+    return passed;
+}